@@ -0,0 +1,805 @@
+/*********************************************************
+ * batch.c  --- Batch job mode of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+#include "vlsm.h"
+#include "batch.h"
+#include "stats.h"
+
+
+/**
+ * buffers of one solver, grown when a job needs more and reused
+ * for every following job
+ */
+typedef struct
+{
+  unsigned long    * n_arr;
+  network_t        * subnets;
+  int                cap;       /* number of elements n_arr/subnets can hold */
+  char             * out;       /* formatted result of the current job */
+  size_t             outlen,
+                     outcap;
+} batch_buf_t;
+
+
+/* make sure @buf holds at least @n requirements, return 0 if out of memory */
+static int
+batch_reserve (batch_buf_t  * buf,
+               int            n)
+{
+  size_t need;
+
+  if (n > buf->cap) {
+    int             cap = buf->cap ? buf->cap : 64;
+    unsigned long * n_arr;
+    network_t     * subnets;
+    while (cap < n) cap = (cap > INT_MAX / 2) ? INT_MAX : cap * 2;
+    STATS_MALLOC(sizeof(unsigned long) * cap);
+    n_arr = (unsigned long *) realloc (buf->n_arr, sizeof(unsigned long) * cap);
+    if (n_arr == NULL) return 0;
+    buf->n_arr = n_arr;
+    STATS_MALLOC(sizeof(network_t) * cap);
+    subnets = (network_t *) realloc (buf->subnets, sizeof(network_t) * cap);
+    if (subnets == NULL) return 0;
+    buf->subnets = subnets;
+    buf->cap = cap;
+  }
+
+  /* "<id>: " + one line per subnet, or a single error line */
+  need = (size_t)(n + 1) * (NETWORK_LINELEN + 32);
+  if (need > buf->outcap) {
+    char * out;
+    STATS_MALLOC(need);
+    out = (char *) realloc (buf->out, need);
+    if (out == NULL) return 0;
+    buf->out = out;
+    buf->outcap = need;
+  }
+  return 1;
+}
+
+
+static void
+batch_buf_free (batch_buf_t * buf)
+{
+  free(buf->n_arr);
+  free(buf->subnets);
+  free(buf->out);
+}
+
+
+static int
+is_blank (char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+
+/**
+ * parse a decimal unsigned long at *s (not beyond e), advance *s past it
+ * return 0 if there is no number or it overflows
+ */
+static int
+parse_ulong (const char     ** s,
+             const char      * e,
+             unsigned long   * value)
+{
+  const char    * p = *s;
+  unsigned long   v = 0;
+
+  if (p == e || (unsigned char)(*p - '0') > 9) return 0;
+  for (; p < e && (unsigned char)(*p - '0') <= 9; p++) {
+    unsigned long d = (unsigned long)(*p - '0');
+    if (v > ((unsigned long)-1 - d) / 10) return 0;
+    v = v * 10 + d;
+  }
+  *s = p;
+  *value = v;
+  return 1;
+}
+
+
+/* append "<id>: " to the output of the current job */
+static void
+batch_put_id (batch_buf_t  * buf,
+              long           id)
+{
+  buf->outlen += (size_t)sprintf(buf->out + buf->outlen, "%ld: ", id);
+}
+
+
+static void
+batch_put_error (batch_buf_t  * buf,
+                 long           id,
+                 const char   * msg)
+{
+  batch_put_id(buf, id);
+  buf->outlen += (size_t)sprintf(buf->out + buf->outlen, "#Error: %s\n", msg);
+}
+
+
+/**
+ * store the nonzero host numbers of [s,e), already checked by
+ * vlsm_parse_hosts(), to the first @cap entries of @nhosts. A requirement
+ * of 0 host takes no space and prints nothing, so it is left out
+ * return the number of nonzero host numbers, INT_MAX at most
+ */
+static int
+batch_nonzero_hosts (unsigned long  * nhosts,
+                     int              cap,
+                     const char     * s,
+                     const char     * e)
+{
+  int n = 0;
+
+  while (s < e) {
+    const char    * t = s;
+    unsigned long   hosts;
+    int             count;
+
+    /* one "H" or "CxH" entry, as vlsm_parse_hosts() splits them */
+    while (t < e && *t != ',' && *t != '.' && !is_blank(*t)) t++;
+    count = vlsm_parse_hosts(&hosts, 1, s, (size_t)(t - s), NULL);
+    if (count > 0 && hosts != 0) {
+      if (count > INT_MAX - n) return INT_MAX;
+      for (; count > 0; count--, n++) {
+        if (n < cap) nhosts[n] = hosts;
+      }
+    }
+    s = (t < e) ? t + 1 : e;
+  }
+  return n;
+}
+
+
+/**
+ * solve the job in [s,e) of the line starting at @line and leave its
+ * formatted result in buf->out
+ * return 1 if solved, 0 if the job failed, -1 if out of memory
+ */
+static int
+batch_solve (batch_buf_t  * buf,
+             long           id,
+             const char   * line,
+             const char   * s,
+             const char   * e)
+{
+  ipv4u32_t       base;
+  unsigned char   err;
+  unsigned long   mask;
+  size_t          used;
+  const char    * slash;
+  size_t          errpos = 0;
+  int             n = 0,
+                  i,
+                  vlsm_code;
+
+  STATS_BEGIN(t_job);
+  STATS_BEGIN(t_parse);
+  buf->outlen = 0;
+  if (!batch_reserve(buf, 0)) return -1;
+
+  /* "base/mask" */
+  for (slash = s; slash < e && *slash != '/'; slash++)
+    ;
+  if (slash == e
+   || ipv4parse(&base, &err, 1, s, (size_t)(slash - s), &used) != 1
+   || err != IPV4_PARSE_OK || used != (size_t)(slash - s))
+  {
+    batch_put_error(buf, id, "invalid base network");
+    return 0;
+  }
+  s = slash + 1;
+  if (!parse_ulong(&s, e, &mask) || mask > 30 || mask == 0) {
+    batch_put_error(buf, id, "invalid net mask");
+    return 0;
+  }
+
+  /* "nhosts nhosts ...", parsed again if they did not fit */
+  if (s < e && !is_blank(*s)) {
+    batch_put_error(buf, id, "invalid net mask");
+    return 0;
+  }
+  n = vlsm_parse_hosts(buf->n_arr, 0, s, (size_t)(e - s), &errpos);
+  if (n < 0) {
+    char msg[64];
+    sprintf(msg, "%s at column %lu", (n == -1) ? "invalid number of hosts" : "too many hosts",
+            (unsigned long)(s - line + errpos) + 1);
+    batch_put_error(buf, id, msg);
+    return 0;
+  }
+  n = batch_nonzero_hosts(buf->n_arr, buf->cap, s, e);
+  if ((uint64_t)n > ((uint64_t)1 << (30 - mask))) {
+    /* more subnets than /30s in the base, do not even make room for them */
+    batch_put_error(buf, id, "too many or no host to address for the given network");
+    return 0;
+  }
+  if (n > 0) {
+    /* the output room depends on n even when the arrays are big enough */
+    int cap = buf->cap;
+    if (!batch_reserve(buf, n)) {
+      /* the room for one error line is still there from batch_reserve(buf, 0) */
+      batch_put_error(buf, id, "memory error");
+      return 0;
+    }
+    if (n > cap) batch_nonzero_hosts(buf->n_arr, buf->cap, s, e);
+  }
+
+  if (n == 0) {
+    batch_put_error(buf, id, "too many or no host to address for the given network");
+    return 0;
+  }
+
+  STATS_END(STATS_PARSE, t_parse);
+
+  /* VLSM */
+  {
+    ipv4_t addr;
+    u32toipv4(addr, base);
+    vlsm_code = vlsm(buf->subnets, addr, (unsigned char)mask, buf->n_arr, n);
+  }
+  if (vlsm_code == -1) {
+    batch_put_error(buf, id, "invalid net mask");
+    return 0;
+  } else if (vlsm_code < 0) {
+    batch_put_error(buf, id, "too many or no host to address for the given network");
+    return 0;
+  }
+
+  /* output */
+  STATS_BEGIN(t_format);
+  for (i=0;i<n;i++) {
+    batch_put_id(buf, id);
+    buf->outlen += fmt_network(buf->out + buf->outlen, &buf->subnets[i]);
+  }
+  STATS_END(STATS_FORMAT, t_format);
+  STATS_JOB(t_job);
+  return 1;
+}
+
+
+/**
+ * a block of whole input lines and the formatted results of their jobs.
+ * Chunks are the unit of work handed to the solver threads
+ */
+typedef struct batch_chunk
+{
+  struct batch_chunk * next;      /* free list link */
+  long                 seq;       /* position in the input, from 0 */
+  long                 first_id;  /* line number of the first line */
+  long                 nlines;
+  const char         * data;      /* whole lines, the last one ends with '\n' or EOF */
+  size_t               datalen;
+  char               * in;        /* read buffer, data points here unless mapped */
+  size_t               inlen,
+                       incap;
+  char               * out;
+  size_t               outlen,
+                       outcap;
+  int                  ret;       /* batch_run() status of this chunk */
+} batch_chunk_t;
+
+/* read this much input per chunk (more if a single line is longer) */
+#define CHUNK_INSIZE  (64 * 1024)
+
+
+static void
+batch_chunk_free (batch_chunk_t * chunk)
+{
+  if (chunk == NULL) return;
+  free(chunk->in);
+  free(chunk->out);
+  free(chunk);
+}
+
+
+/**
+ * solve every job of @chunk with scratch buffers @buf and leave the
+ * results in chunk->out
+ */
+static void
+batch_solve_chunk (batch_buf_t    * buf,
+                   batch_chunk_t  * chunk)
+{
+  const char  * s = chunk->data;
+  const char  * end = chunk->data + chunk->datalen;
+  long          id = chunk->first_id;
+
+  chunk->outlen = 0;
+  chunk->ret = 0;
+  for (; s < end; id++) {
+    const char * e = memchr(s, '\n', (size_t)(end - s));
+    const char * line = s;
+    const char * next;
+    int          r;
+
+    if (e == NULL) e = end;
+    next = (e < end) ? e + 1 : end;
+    while (s < e && is_blank(*s)) s++;
+    if (s == e || *s == '#') {
+      s = next;
+      continue;
+    }
+
+    r = batch_solve(buf, id, line, s, e);
+    s = next;
+    if (r < 0) {
+      chunk->ret = 3;
+      return;
+    }
+    if (r == 0) chunk->ret = 1;
+
+    if (chunk->outcap - chunk->outlen < buf->outlen) {
+      size_t  cap = chunk->outcap ? chunk->outcap : CHUNK_INSIZE;
+      char  * out;
+      while (cap - chunk->outlen < buf->outlen) cap *= 2;
+      STATS_MALLOC(cap);
+      out = (char *) realloc (chunk->out, cap);
+      if (out == NULL) {
+        chunk->ret = 3;
+        return;
+      }
+      chunk->out = out;
+      chunk->outcap = cap;
+    }
+    memcpy(chunk->out + chunk->outlen, buf->out, buf->outlen);
+    chunk->outlen += buf->outlen;
+  }
+}
+
+
+/**
+ * where the jobs come from: a read-only mapping of the whole input when
+ * it is a regular file, otherwise a FILE read in chunks
+ */
+typedef struct
+{
+  FILE            * file;
+  batch_chunk_t     carry;      /* partial line left over by the last read */
+  const char      * map;
+  size_t            maplen,
+                    mappos;
+  long              next_id;    /* line number of the next chunk */
+} batch_input_t;
+
+
+static void
+batch_input_open (batch_input_t  * input,
+                  FILE           * in)
+{
+  memset(input, 0, sizeof(*input));
+  input->file = in;
+  input->next_id = 1;
+#ifndef _WIN32
+  {
+    struct stat st;
+    int         fd = fileno(in);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+     && (uint64_t)st.st_size <= (size_t)-1)
+    {
+      void * p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        posix_madvise(p, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+        input->map = (const char *)p;
+        input->maplen = (size_t)st.st_size;
+      }
+    }
+  }
+#endif
+}
+
+
+static void
+batch_input_close (batch_input_t * input)
+{
+#ifndef _WIN32
+  if (input->map) munmap((void *)input->map, input->maplen);
+#endif
+  free(input->carry.in);
+}
+
+
+/**
+ * read whole lines from input->file into chunk->in, carrying a trailing
+ * partial line over to the next call
+ * return 1 if the chunk has input, 0 at end of input, -1 on error
+ */
+static int
+batch_read_lines (batch_input_t  * input,
+                  batch_chunk_t  * chunk)
+{
+  batch_chunk_t * carry = &input->carry;
+  FILE          * in = input->file;
+  size_t          keep;
+  char          * nl;
+
+  /* start with the carried partial line */
+  if (chunk->incap < carry->inlen + CHUNK_INSIZE) {
+    size_t  cap = carry->inlen + CHUNK_INSIZE;
+    char  * p = (char *) realloc (chunk->in, cap);
+    if (p == NULL) return -1;
+    chunk->in = p;
+    chunk->incap = cap;
+  }
+  if (carry->inlen > 0) memcpy(chunk->in, carry->in, carry->inlen);
+  chunk->inlen = carry->inlen;
+  carry->inlen = 0;
+
+  /* read until we have at least one complete line */
+  for (;;) {
+    size_t n = fread(chunk->in + chunk->inlen, 1, chunk->incap - chunk->inlen, in);
+    chunk->inlen += n;
+    if (n == 0) {
+      if (ferror(in)) return -1;
+      break;   /* EOF, whatever we have is the last line */
+    }
+    nl = memchr(chunk->in + chunk->inlen - n, '\n', n);
+    if (nl != NULL) break;
+    if (chunk->inlen == chunk->incap) {
+      char * p = (char *) realloc (chunk->in, chunk->incap * 2);
+      if (p == NULL) return -1;
+      chunk->in = p;
+      chunk->incap *= 2;
+    }
+  }
+  if (chunk->inlen == 0) return 0;
+
+  /* keep whole lines, carry the rest over */
+  if (!feof(in)) {
+    for (nl = chunk->in + chunk->inlen; nl[-1] != '\n'; nl--)
+      ;
+    keep = (size_t)(nl - chunk->in);
+    if (carry->incap < chunk->inlen - keep + 1) {
+      char * p = (char *) realloc (carry->in, chunk->inlen - keep + CHUNK_INSIZE);
+      if (p == NULL) return -1;
+      carry->in = p;
+      carry->incap = chunk->inlen - keep + CHUNK_INSIZE;
+    }
+    carry->inlen = chunk->inlen - keep;
+    memcpy(carry->in, nl, carry->inlen);
+    chunk->inlen = keep;
+  }
+  chunk->data = chunk->in;
+  chunk->datalen = chunk->inlen;
+  return 1;
+}
+
+
+/**
+ * point @chunk at the next block of whole lines of @input and number it
+ * return 1 if the chunk has input, 0 at end of input, -1 on error
+ */
+static int
+batch_next_chunk (batch_input_t  * input,
+                  batch_chunk_t  * chunk)
+{
+  if (input->map) {
+    /* zero-copy: about CHUNK_INSIZE bytes of the mapping, up to a '\n' */
+    const char * p = input->map + input->mappos;
+    size_t       left = input->maplen - input->mappos,
+                 len = (left < CHUNK_INSIZE) ? left : CHUNK_INSIZE;
+    const char * nl;
+
+    if (left == 0) return 0;
+    nl = memchr(p + len - 1, '\n', left - len + 1);
+    len = (nl != NULL) ? (size_t)(nl - p) + 1 : left;
+    chunk->data = p;
+    chunk->datalen = len;
+    input->mappos += len;
+  } else {
+    int r = batch_read_lines(input, chunk);
+    if (r <= 0) return r;
+  }
+
+  /* count the lines so the next chunk knows its first job id */
+  {
+    const char * p = chunk->data;
+    const char * e = chunk->data + chunk->datalen;
+    chunk->nlines = 0;
+    while (p < e && (p = memchr(p, '\n', (size_t)(e - p))) != NULL) {
+      chunk->nlines++;
+      p++;
+    }
+    if (e[-1] != '\n') chunk->nlines++;
+  }
+  chunk->first_id = input->next_id;
+  input->next_id += chunk->nlines;
+  return 1;
+}
+
+
+/* single threaded batch_run() */
+static int
+batch_run_serial (FILE  * in,
+                  FILE  * out)
+{
+  batch_buf_t     buf;
+  batch_chunk_t   chunk;
+  batch_input_t   input;
+  int             r,
+                  ret = 0;
+
+  memset(&buf, 0, sizeof(buf));
+  memset(&chunk, 0, sizeof(chunk));
+  batch_input_open(&input, in);
+  while ((r = batch_next_chunk(&input, &chunk)) > 0) {
+    batch_solve_chunk(&buf, &chunk);
+    if (chunk.ret > ret) ret = chunk.ret;
+    if (chunk.ret == 3) break;
+    if (fwrite(chunk.out, 1, chunk.outlen, out) != chunk.outlen) {
+      ret = 3;
+      break;
+    }
+  }
+  if (r < 0) ret = 3;
+
+  free(chunk.in);
+  free(chunk.out);
+  batch_input_close(&input);
+  batch_buf_free(&buf);
+  return ret;
+}
+
+
+/**** thread pool ****
+ * the calling thread reads chunks onto one FIFO that all workers take
+ * from. Solved chunks go to a reorder window where the writer thread
+ * picks them up in input order. At most `window` chunks are in flight,
+ * which bounds the queue.
+ */
+
+typedef struct
+{
+  pthread_mutex_t    lock;
+  pthread_cond_t     work_cv;   /* the queue got a chunk, or eof */
+  pthread_cond_t     done_cv;   /* a chunk was solved */
+  pthread_cond_t     free_cv;   /* a chunk was written */
+  batch_chunk_t    * head,      /* chunks waiting for a worker, linked */
+                   * tail;      /* through ->next */
+  int                window;
+  batch_chunk_t   ** done;      /* reorder window, indexed by seq % window */
+  batch_chunk_t    * free_list;
+  long               inflight,
+                     next_write;
+  int                eof,       /* reader finished, total = number of chunks */
+                     stop,      /* abort, e.g. output error */
+                     ret;
+  long               total;
+  FILE             * out;
+} batch_pool_t;
+
+
+/* take the oldest waiting chunk. Called locked */
+static batch_chunk_t *
+batch_pool_take (batch_pool_t * pool)
+{
+  batch_chunk_t * chunk = pool->head;
+  if (chunk != NULL) {
+    pool->head = chunk->next;
+    if (pool->head == NULL) pool->tail = NULL;
+    chunk->next = NULL;
+  }
+  return chunk;
+}
+
+
+static void *
+batch_worker (void * arg)
+{
+  batch_pool_t    * pool = (batch_pool_t *) arg;
+  batch_buf_t       buf;
+
+  memset(&buf, 0, sizeof(buf));
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    batch_chunk_t * chunk;
+    while ((chunk = batch_pool_take(pool)) == NULL
+        && !pool->eof && !pool->stop)
+    {
+      pthread_cond_wait(&pool->work_cv, &pool->lock);
+    }
+    if (chunk == NULL) break;
+    pthread_mutex_unlock(&pool->lock);
+
+    batch_solve_chunk(&buf, chunk);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->done[chunk->seq % pool->window] = chunk;
+    if (chunk->seq == pool->next_write) pthread_cond_signal(&pool->done_cv);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  batch_buf_free(&buf);
+  return NULL;
+}
+
+
+static void *
+batch_writer (void * arg)
+{
+  batch_pool_t * pool = (batch_pool_t *) arg;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    batch_chunk_t * chunk;
+    int             ok;
+    while ((chunk = pool->done[pool->next_write % pool->window]) == NULL
+        && !(pool->eof && pool->next_write == pool->total) && !pool->stop)
+    {
+      pthread_cond_wait(&pool->done_cv, &pool->lock);
+    }
+    if (chunk == NULL) break;
+    pool->done[pool->next_write % pool->window] = NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    ok = (chunk->ret == 3)
+      || fwrite(chunk->out, 1, chunk->outlen, pool->out) == chunk->outlen;
+
+    pthread_mutex_lock(&pool->lock);
+    if (chunk->ret > pool->ret) pool->ret = chunk->ret;
+    if (!ok || chunk->ret == 3) {
+      pool->ret = 3;
+      pool->stop = 1;
+      pthread_cond_broadcast(&pool->work_cv);
+      pthread_cond_broadcast(&pool->free_cv);
+    }
+    pool->next_write++;
+    pool->inflight--;
+    chunk->next = pool->free_list;
+    pool->free_list = chunk;
+    pthread_cond_signal(&pool->free_cv);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+
+/* multi threaded batch_run(), @nthreads solver threads */
+static int
+batch_run_pool (FILE  * in,
+                FILE  * out,
+                int     nthreads)
+{
+  batch_pool_t      pool;
+  pthread_t       * threads,
+                    writer;
+  batch_input_t     input;
+  int               i,
+                    nstarted,
+                    writer_started,
+                    r = 1,
+                    ret;
+
+  if (nthreads > BATCH_MAX_THREADS) nthreads = BATCH_MAX_THREADS;
+  memset(&pool, 0, sizeof(pool));
+  pool.window = nthreads * 4;
+  pool.out = out;
+  pool.done = (batch_chunk_t **) calloc (pool.window, sizeof(batch_chunk_t *));
+  threads = (pthread_t *) calloc (nthreads, sizeof(pthread_t));
+  if (pool.done == NULL || threads == NULL) {
+    fprintf(out, "#Error: memory error\n");
+    free(pool.done);
+    free(threads);
+    return 3;
+  }
+
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init(&pool.work_cv, NULL);
+  pthread_cond_init(&pool.done_cv, NULL);
+  pthread_cond_init(&pool.free_cv, NULL);
+  for (nstarted=0;nstarted<nthreads;nstarted++) {
+    if (pthread_create(&threads[nstarted], NULL, batch_worker, &pool) != 0) break;
+  }
+  writer_started = (nstarted == nthreads)
+                && pthread_create(&writer, NULL, batch_writer, &pool) == 0;
+  if (!writer_started) {
+    /* the threads already running see stop and leave */
+    fprintf(out, "#Error: cannot start %d threads\n", nthreads + 1);
+    r = -1;
+    pool.stop = 1;
+  }
+
+  /* reader */
+  batch_input_open(&input, in);
+  while (r > 0) {
+    batch_chunk_t * chunk;
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.inflight >= pool.window && !pool.stop) {
+      pthread_cond_wait(&pool.free_cv, &pool.lock);
+    }
+    if (pool.stop) {
+      pthread_mutex_unlock(&pool.lock);
+      break;
+    }
+    chunk = pool.free_list;
+    if (chunk != NULL) pool.free_list = chunk->next;
+    pthread_mutex_unlock(&pool.lock);
+
+    if (chunk == NULL) chunk = (batch_chunk_t *) calloc (1, sizeof(batch_chunk_t));
+    if (chunk == NULL || (r = batch_next_chunk(&input, chunk)) <= 0) {
+      if (chunk == NULL) r = -1;
+      batch_chunk_free(chunk);
+      break;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    chunk->seq = pool.total++;
+    chunk->next = NULL;
+    if (pool.tail != NULL) pool.tail->next = chunk;
+    else pool.head = chunk;
+    pool.tail = chunk;
+    pool.inflight++;
+    pthread_cond_signal(&pool.work_cv);
+    pthread_mutex_unlock(&pool.lock);
+  }
+
+  pthread_mutex_lock(&pool.lock);
+  pool.eof = 1;
+  pthread_cond_broadcast(&pool.work_cv);
+  pthread_cond_broadcast(&pool.done_cv);
+  pthread_mutex_unlock(&pool.lock);
+  for (i=0;i<nstarted;i++) {
+    pthread_join(threads[i], NULL);
+  }
+  if (writer_started) pthread_join(writer, NULL);
+
+  ret = (r < 0) ? 3 : pool.ret;
+
+  /* clean up, chunks left in the queue only exist after a stop */
+  {
+    batch_chunk_t * chunk;
+    while ((chunk = batch_pool_take(&pool)) != NULL) batch_chunk_free(chunk);
+  }
+  for (i=0;i<pool.window;i++) {
+    batch_chunk_free(pool.done[i]);
+  }
+  while (pool.free_list != NULL) {
+    batch_chunk_t * next = pool.free_list->next;
+    batch_chunk_free(pool.free_list);
+    pool.free_list = next;
+  }
+  batch_input_close(&input);
+  free(pool.done);
+  free(threads);
+  pthread_mutex_destroy(&pool.lock);
+  pthread_cond_destroy(&pool.work_cv);
+  pthread_cond_destroy(&pool.done_cv);
+  pthread_cond_destroy(&pool.free_cv);
+  return ret;
+}
+
+
+int
+batch_run (FILE  * in,
+           FILE  * out,
+           int     nthreads)
+{
+  if (nthreads <= 1) return batch_run_serial(in, out);
+  return batch_run_pool(in, out, nthreads);
+}
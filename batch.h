@@ -0,0 +1,49 @@
+/*********************************************************
+ * batch.h  --- Batch job mode of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+
+/**
+ * solve every job read from @in and write the results to @out
+ *
+ * input: one job per line, "base_network/base_mask nhosts nhosts ..."
+ *        blank lines and lines starting with '#' are ignored
+ * output: every line is prefixed by "<job id>: ", the job id being the
+ *        line number of the job in @in. A solved job prints one
+ *        print_network() line per subnet (0 host subnets hidden), a failed
+ *        job prints a single "#Error: ..." line
+ *
+ * With @nthreads > 1 the jobs are solved by that many threads, at most
+ * BATCH_MAX_THREADS, the output is still written in input order. If the
+ * threads cannot be started a single "#Error: ..." line is written
+ *
+ * Return:
+ *    0 : all jobs solved
+ *    1 : at least one job failed
+ *    3 : memory or I/O error
+ */
+#define BATCH_MAX_THREADS   256
+
+int                   batch_run           (FILE               * in,
+                                           FILE               * out,
+                                           int                  nthreads);
+
+#endif
@@ -0,0 +1,483 @@
+/*********************************************************
+ * bench.c  --- Benchmarks of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+/**
+ * Times the address primitives in ns per call, then vlsm() end to end at
+ * 10, 1k, 100k and 10M requirements, and a few of the bigger users of it.
+ * Every benchmark is run with more and more iterations until it takes
+ * BENCH_MIN_NS, and the best of BENCH_RUNS such runs is kept.
+ *
+ * Output is one tab separated line per benchmark, lines starting with '#'
+ * are comments:
+ *   name  items  ns_per_op  items_per_sec  allocs_per_op  peak_rss_kb  [vs_baseline]
+ * items is the number of things one op handles (requirements of a vlsm()
+ * call, addresses of a lookup batch, ...). allocs_per_op counts malloc,
+ * calloc and realloc calls when built with BENCH_COUNT_ALLOCS and the
+ * linker wraps them (see the bench target of the Makefile), "-" otherwise.
+ * peak_rss_kb is the peak of the whole process so far; the sizes only
+ * grow, so for the vlsm() runs it is the peak of the largest one.
+ *
+ * With -b file, a saved output is the baseline: vs_baseline is the change
+ * of ns_per_op against the line of the same name and items, and the count
+ * of benchmarks more than BENCH_SLOWER percent slower is printed at the end.
+ *
+ * usage: bench_vlsm [-s max_requirements] [-b baseline]
+ *   make bench    writes bench.tsv, compared to bench_baseline.tsv if it
+ *                 exists; copy it there to make it the baseline
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#include "vlsm.h"
+#include "lpm.h"
+
+#define BENCH_MIN_NS    50000000.0    /* 50 ms */
+#define BENCH_RUNS      3
+#define BENCH_SLOWER    10.0
+#define BENCH_SET       4096          /* inputs of a primitive, cycled */
+#define BENCH_MAXBASE   128
+
+typedef struct
+{
+  char      name[32];
+  long      items;
+  double    ns;
+} result_t;
+
+typedef struct
+{
+  FILE      * out;
+  result_t    base[BENCH_MAXBASE];
+  int         nbase,
+              nslower;
+} report_t;
+
+
+/*** allocation counting ***/
+
+static long nallocs;
+
+#ifdef BENCH_COUNT_ALLOCS
+void * __real_malloc (size_t);
+void * __real_calloc (size_t, size_t);
+void * __real_realloc (void *, size_t);
+
+void *
+__wrap_malloc (size_t n)
+{
+  nallocs++;
+  return __real_malloc(n);
+}
+
+void *
+__wrap_calloc (size_t n,
+               size_t size)
+{
+  nallocs++;
+  return __real_calloc(n, size);
+}
+
+void *
+__wrap_realloc (void    * p,
+                size_t    n)
+{
+  nallocs++;
+  return __real_realloc(p, n);
+}
+#endif
+
+
+/*** inputs ***/
+
+static ipv4str_t        strs[BENCH_SET];
+static ipv4_t           addrs[BENCH_SET];
+static ipv4u32_t        addrs32[BENCH_SET];
+static unsigned long    nhosts[BENCH_SET];
+static network_t        nets[BENCH_SET];
+static char             text[BENCH_SET * IPV4_STRLEN];
+static size_t           textlen;
+static volatile long    sink;
+
+static unsigned int
+xorshift (unsigned int * s)
+{
+  *s ^= *s << 13;
+  *s ^= *s >> 17;
+  *s ^= *s << 5;
+  return *s;
+}
+
+/* random number of hosts for a subnet, mostly small as in real plans */
+static unsigned long
+rand_hosts (unsigned int * s)
+{
+  unsigned int r = xorshift(s);
+  return 2 + (r >> 8) % ((r & 7) == 0 ? 250 : 12);
+}
+
+static void
+make_inputs (void)
+{
+  unsigned int  s = 2463534242U;
+  int           i;
+
+  for (i=0;i<BENCH_SET;i++) {
+    ipv4u32_t a = xorshift(&s);
+    u32toipv4(addrs[i], a);
+    addrs32[i] = a;
+    ipv4tostr(strs[i], addrs[i]);
+    nhosts[i] = rand_hosts(&s);
+    makenetwork(&nets[i], addrs[i], (unsigned char)(8 + xorshift(&s) % 23));
+    textlen += ipv4fmt(text + textlen, a);
+    text[textlen++] = '\n';
+  }
+}
+
+
+/*** timing ***/
+
+static double
+now_ns (void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static long
+peak_rss_kb (void)
+{
+#ifndef _WIN32
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) == 0) return ru.ru_maxrss;
+#endif
+  return -1;
+}
+
+
+/* one benchmark: @fn does @n ops on @arg */
+typedef void (*bench_fn) (void * arg, long n);
+
+static void
+bench (report_t       * rep,
+       const char     * name,
+       long             items,
+       bench_fn         fn,
+       void           * arg)
+{
+  double  best = 0;
+  long    n = 1,
+          allocs = 0;
+  int     run,
+          i;
+
+  /* find how many ops take BENCH_MIN_NS */
+  for (;;) {
+    double t = now_ns();
+    fn(arg, n);
+    t = now_ns() - t;
+    if (t >= BENCH_MIN_NS || n >= (1L << 40)) break;
+    n = (t < BENCH_MIN_NS / 100) ? n * 100 : n * 2;
+  }
+  for (run=0;run<BENCH_RUNS;run++) {
+    long    a = nallocs;
+    double  t = now_ns();
+    fn(arg, n);
+    t = (now_ns() - t) / n;
+    if (run == 0 || t < best) best = t;
+    allocs = nallocs - a;
+  }
+
+  fprintf(rep->out, "%s\t%ld\t%.2f\t%.0f\t", name, items, best, items * 1e9 / best);
+#ifdef BENCH_COUNT_ALLOCS
+  fprintf(rep->out, "%.2f\t", (double)allocs / n);
+#else
+  (void)allocs;
+  fprintf(rep->out, "-\t");
+#endif
+  fprintf(rep->out, "%ld", peak_rss_kb());
+
+  for (i=0;i<rep->nbase;i++) {
+    if (rep->base[i].items == items && strcmp(rep->base[i].name, name) == 0) {
+      double change = (best / rep->base[i].ns - 1) * 100;
+      fprintf(rep->out, "\t%+.1f%%", change);
+      if (change > BENCH_SLOWER) rep->nslower++;
+      break;
+    }
+  }
+  fprintf(rep->out, "\n");
+  fflush(rep->out);
+}
+
+
+/*** primitives ***/
+
+static void
+b_strtoipv4 (void * arg, long n)
+{
+  ipv4_t  a;
+  long    i,
+          s = 0;
+  (void)arg;
+  for (i=0;i<n;i++) {
+    s += strtoipv4(a, strs[i & (BENCH_SET - 1)]);
+    s += a[3];
+  }
+  sink = s;
+}
+
+static void
+b_ipv4parse (void * arg, long n)
+{
+  ipv4u32_t       out[BENCH_SET];
+  unsigned char   errs[BENCH_SET];
+  long            i;
+  (void)arg;
+  for (i=0;i<n;i++) {
+    sink = (long)ipv4parse(out, errs, BENCH_SET, text, textlen, NULL);
+  }
+}
+
+static void
+b_ipv4add (void * arg, long n)
+{
+  ipv4_t  a;
+  long    i,
+          s = 0;
+  (void)arg;
+  for (i=0;i<n;i++) {
+    ipv4cpy(a, addrs[i & (BENCH_SET - 1)]);
+    s += ipv4add(a, nhosts[i & (BENCH_SET - 1)]);
+    s += a[3];
+  }
+  sink = s;
+}
+
+static void
+b_calmask (void * arg, long n)
+{
+  long i,
+       s = 0;
+  (void)arg;
+  for (i=0;i<n;i++) s += calmask(nhosts[i & (BENCH_SET - 1)], 8);
+  sink = s;
+}
+
+static void
+b_hoststoprefix (void * arg, long n)
+{
+  long i,
+       s = 0;
+  (void)arg;
+  for (i=0;i<n;i++) s += hoststoprefix(nhosts[i & (BENCH_SET - 1)]);
+  sink = s;
+}
+
+static void
+b_fmt_network (void * arg, long n)
+{
+  char  line[NETWORK_LINELEN];
+  long  i,
+        s = 0;
+  (void)arg;
+  for (i=0;i<n;i++) s += (long)fmt_network(line, &nets[i & (BENCH_SET - 1)]);
+  sink = s;
+}
+
+static void
+b_print_plan (void * arg, long n)
+{
+  long i;
+  for (i=0;i<n;i++) print_plan((FILE *)arg, nets, nhosts, BENCH_SET);
+}
+
+
+/*** solvers ***/
+
+typedef struct
+{
+  network_t       * subnets;
+  unsigned long   * nhosts;
+  int               n;
+  ipv4_t            addr;
+  unsigned char     mask;
+  lpm_t           * lpm;
+  int             * idx;
+} solve_t;
+
+static void
+b_vlsm (void * arg, long n)
+{
+  solve_t * s = (solve_t *)arg;
+  long      i;
+  for (i=0;i<n;i++) sink = vlsm(s->subnets, s->addr, s->mask, s->nhosts, s->n);
+}
+
+static void
+b_summarize (void * arg, long n)
+{
+  solve_t   * s = (solve_t *)arg;
+  network_t * copy = (network_t *) malloc (sizeof(network_t) * s->n);
+  long        i;
+  for (i=0;i<n && copy;i++) {
+    memcpy(copy, s->subnets, sizeof(network_t) * s->n);
+    sink = vlsm_summarize(copy, s->n);
+  }
+  free(copy);
+}
+
+static void
+b_lpm_lookup (void * arg, long n)
+{
+  solve_t * s = (solve_t *)arg;
+  long      i;
+  for (i=0;i<n;i++) lpm_lookup_batch(s->lpm, addrs32, s->idx, BENCH_SET);
+}
+
+
+/**
+ * a problem of @n requirements in a base network just big enough for it
+ * RETURN 0 if out of memory
+ */
+static int
+make_problem (solve_t * s, int n)
+{
+  unsigned int  r = 88172645U;
+  uint64_t      total = 0;
+  int           i;
+
+  s->n = n;
+  s->subnets = (network_t *) malloc (sizeof(network_t) * n);
+  s->nhosts = (unsigned long *) malloc (sizeof(unsigned long) * n);
+  if (s->subnets == NULL || s->nhosts == NULL) return 0;
+  for (i=0;i<n;i++) {
+    s->nhosts[i] = rand_hosts(&r);
+    total += calahosts(calmask(s->nhosts[i], 0));
+  }
+  for (s->mask=30; s->mask>1 && calahosts(s->mask) < total * 2; s->mask--)
+    ;
+  makeipv4(s->addr, 10, 0, 0, 0);
+  if (s->mask < 8) makeipv4(s->addr, 0, 0, 0, 0);
+  return 1;
+}
+
+static void
+free_problem (solve_t * s)
+{
+  free(s->subnets);
+  free(s->nhosts);
+  memset(s, 0, sizeof(*s));
+}
+
+
+/* read a saved output as the baseline */
+static int
+read_baseline (report_t * rep, const char * path)
+{
+  FILE  * f = fopen(path, "r");
+  char    line[256];
+
+  if (f == NULL) return 0;
+  while (rep->nbase < BENCH_MAXBASE && fgets(line, sizeof(line), f) != NULL) {
+    result_t * b = &rep->base[rep->nbase];
+    if (line[0] == '#') continue;
+    if (sscanf(line, "%31s %ld %lf", b->name, &b->items, &b->ns) == 3) rep->nbase++;
+  }
+  fclose(f);
+  return 1;
+}
+
+
+int
+main (int     argc,
+      char  * argv[])
+{
+  static const long   sizes[] = {10, 1000, 100000, 10000000};
+  report_t            rep;
+  solve_t             s;
+  FILE              * devnull;
+  long                max_n = 10000000;
+  int                 i;
+
+  memset(&rep, 0, sizeof(rep));
+  rep.out = stdout;
+  for (i=1;i<argc;i++) {
+    if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      max_n = atol(argv[++i]);
+    } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+      if (!read_baseline(&rep, argv[++i])) {
+        fprintf(stderr, "cannot read %s\n", argv[i]);
+        return 2;
+      }
+    } else {
+      fprintf(stderr, "usage: %s [-s max_requirements] [-b baseline]\n", argv[0]);
+      return 2;
+    }
+  }
+  devnull = fopen("/dev/null", "w");
+  if (devnull == NULL) devnull = tmpfile();
+  make_inputs();
+
+  fprintf(rep.out, "# VLSM Solver %s benchmarks\n", VLSM_VERSION);
+  fprintf(rep.out, "# name\titems\tns_per_op\titems_per_sec\tallocs_per_op\tpeak_rss_kb%s\n",
+          rep.nbase ? "\tvs_baseline" : "");
+  bench(&rep, "strtoipv4", 1, b_strtoipv4, NULL);
+  bench(&rep, "ipv4parse", BENCH_SET, b_ipv4parse, NULL);
+  bench(&rep, "ipv4add", 1, b_ipv4add, NULL);
+  bench(&rep, "calmask", 1, b_calmask, NULL);
+  bench(&rep, "hoststoprefix", 1, b_hoststoprefix, NULL);
+  bench(&rep, "fmt_network", 1, b_fmt_network, NULL);
+  if (devnull != NULL) bench(&rep, "print_plan", BENCH_SET, b_print_plan, devnull);
+
+  for (i=0;i<(int)(sizeof(sizes)/sizeof(sizes[0])) && sizes[i]<=max_n;i++) {
+    memset(&s, 0, sizeof(s));
+    if (!make_problem(&s, (int)sizes[i])) {
+      fprintf(rep.out, "# out of memory for %ld requirements\n", sizes[i]);
+      free_problem(&s);
+      break;
+    }
+    bench(&rep, "vlsm", sizes[i], b_vlsm, &s);
+    if (sizes[i] == 100000) {
+      /* the users of a solved plan */
+      vlsm(s.subnets, s.addr, s.mask, s.nhosts, s.n);
+      bench(&rep, "vlsm_summarize", sizes[i], b_summarize, &s);
+      s.lpm = lpm_new(s.subnets, s.n);
+      s.idx = (int *) malloc (sizeof(int) * BENCH_SET);
+      if (s.lpm != NULL && s.idx != NULL) {
+        bench(&rep, "lpm_lookup_batch", BENCH_SET, b_lpm_lookup, &s);
+      }
+      lpm_free(s.lpm);
+      free(s.idx);
+    }
+    free_problem(&s);
+  }
+
+  if (rep.nbase) {
+    fprintf(rep.out, "# %d benchmarks more than %.0f%% slower than the baseline\n",
+            rep.nslower, BENCH_SLOWER);
+  }
+  if (devnull != NULL) fclose(devnull);
+  return 0;
+}
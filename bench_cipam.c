@@ -0,0 +1,263 @@
+/*********************************************************
+ * bench_cipam.c  --- Stress benchmark of the lock-free prefix allocator
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+/**
+ * Every thread allocates and releases random /28 - /30 prefixes of one
+ * shared /12 pool, keeping up to LIVE_MAX of them. The lock-free cipam_t
+ * is run against ipam_t behind one mutex, for 1, 2, 4, ... threads.
+ * With -c every address of a prefix is also claimed in a shared map, so
+ * two threads that get overlapping prefixes are caught. Only thread
+ * counts up to the number of online CPUs say anything about scaling
+ *
+ * usage: bench_cipam [-c] [-n ops_per_thread] [max_threads]
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "vlsm.h"
+#include "ipam.h"
+#include "cipam.h"
+
+#define BASE_MASK   12
+#define MIN_LEN     28
+#define MAX_LEN     30
+#define LIVE_MAX    256
+
+typedef struct
+{
+  cipam_t           * cipam;    /* NULL: use ipam and lock */
+  ipam_t            * ipam;
+  pthread_mutex_t   * lock;
+  unsigned char     * owner;    /* one byte per /MAX_LEN, NULL if not checking */
+  ipv4u32_t           start;
+  long                nops;
+  unsigned int        seed;
+  long                overlaps,
+                      failed;
+} worker_t;
+
+
+static unsigned int
+xorshift (unsigned int * s)
+{
+  *s ^= *s << 13;
+  *s ^= *s >> 17;
+  *s ^= *s << 5;
+  return *s;
+}
+
+
+static int
+pool_alloc (worker_t        * w,
+            unsigned char     len,
+            network_t       * subnet)
+{
+  int r;
+  if (w->cipam) return cipam_alloc(w->cipam, len, subnet);
+  pthread_mutex_lock(w->lock);
+  r = ipam_alloc(w->ipam, len, subnet);
+  pthread_mutex_unlock(w->lock);
+  return r;
+}
+
+
+static void
+pool_release (worker_t         * w,
+              const network_t  * subnet)
+{
+  if (w->cipam) {
+    cipam_release(w->cipam, subnet);
+    return;
+  }
+  pthread_mutex_lock(w->lock);
+  ipam_release(w->ipam, subnet);
+  pthread_mutex_unlock(w->lock);
+}
+
+
+/* claim (set 1) or give back (set 0) the addresses of @subnet in the map */
+static void
+mark (worker_t          * w,
+      const network_t   * subnet,
+      unsigned char       set)
+{
+  size_t first = (ipv4tou32(subnet->addr) - w->start) >> (IPV4_BITLEN - MAX_LEN),
+         n = (size_t)1 << (MAX_LEN - subnet->mask),
+         k;
+  for (k=0;k<n;k++) {
+    if (__atomic_exchange_n(&w->owner[first + k], set, __ATOMIC_ACQ_REL) == set) {
+      w->overlaps++;
+    }
+  }
+}
+
+
+static void *
+worker (void * arg)
+{
+  worker_t  * w = (worker_t *) arg;
+  network_t   live[LIVE_MAX];
+  int         nlive = 0;
+  long        op;
+
+  for (op=0;op<w->nops;op++) {
+    unsigned int r = xorshift(&w->seed);
+    if (nlive == 0 || (nlive < LIVE_MAX && (r & 1))) {
+      if (pool_alloc(w, MIN_LEN + (r >> 1) % (MAX_LEN - MIN_LEN + 1), &live[nlive]) == 0) {
+        if (w->owner) mark(w, &live[nlive], 1);
+        nlive++;
+      } else {
+        w->failed++;
+      }
+    } else {
+      int i = (r >> 1) % nlive;
+      if (w->owner) mark(w, &live[i], 0);
+      pool_release(w, &live[i]);
+      live[i] = live[--nlive];
+    }
+  }
+  while (nlive > 0) {
+    nlive--;
+    if (w->owner) mark(w, &live[nlive], 0);
+    pool_release(w, &live[nlive]);
+  }
+  return NULL;
+}
+
+
+/* run @nthreads workers, RETURN million operations per second */
+static double
+run (int               nthreads,
+     long              nops,
+     int               locked,
+     unsigned char   * owner,
+     long            * overlaps,
+     int             * whole)
+{
+  static const ipv4_t   base_addr = {10, 0, 0, 0};
+  network_t             base,
+                        all;
+  pthread_mutex_t       lock = PTHREAD_MUTEX_INITIALIZER;
+  pthread_t           * tids = (pthread_t *) malloc (sizeof(pthread_t) * nthreads);
+  worker_t            * ws = (worker_t *) calloc (nthreads, sizeof(worker_t));
+  cipam_t             * cipam = NULL;
+  ipam_t              * ipam = NULL;
+  struct timespec       t0,
+                        t1;
+  int                   i;
+
+  makenetwork(&base, base_addr, BASE_MASK);
+  if (locked) ipam = ipam_new(&base);
+  else cipam = cipam_new(&base, MAX_LEN);
+  if (tids == NULL || ws == NULL || (cipam == NULL && ipam == NULL)) {
+    fprintf(stderr, "out of memory\n");
+    exit(3);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (i=0;i<nthreads;i++) {
+    ws[i].cipam = cipam;
+    ws[i].ipam = ipam;
+    ws[i].lock = &lock;
+    ws[i].owner = owner;
+    ws[i].start = ipv4tou32(base_addr);
+    ws[i].nops = nops;
+    ws[i].seed = 2463534242U + 7919U * i;
+    pthread_create(&tids[i], NULL, worker, &ws[i]);
+  }
+  for (i=0;i<nthreads;i++) {
+    pthread_join(tids[i], NULL);
+    *overlaps += ws[i].overlaps;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  /* everything is back, the buddies must have merged into the base again */
+  *whole = (locked ? ipam_alloc(ipam, BASE_MASK, &all) : cipam_alloc(cipam, BASE_MASK, &all)) == 0;
+
+  cipam_free(cipam);
+  ipam_free(ipam);
+  free(tids);
+  free(ws);
+  return (double)nthreads * nops
+       / ((t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3);
+}
+
+
+int
+main (int     argc,
+      char  * argv[])
+{
+  unsigned char * owner = NULL;
+  long            nops = 200000,
+                  overlaps = 0;
+  int             max_threads = 64,
+                  check = 0,
+                  ok = 1,
+                  n,
+                  i;
+
+  for (i=1;i<argc;i++) {
+    if (strcmp(argv[i], "-c") == 0) {
+      check = 1;
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      nops = atol(argv[++i]);
+    } else {
+      max_threads = atoi(argv[i]);
+    }
+  }
+  if (nops <= 0 || max_threads <= 0) {
+    fprintf(stderr, "usage: %s [-c] [-n ops_per_thread] [max_threads]\n", argv[0]);
+    return 2;
+  }
+  if (check) {
+    owner = (unsigned char *) calloc ((size_t)1 << (MAX_LEN - BASE_MASK), 1);
+    if (owner == NULL) {
+      fprintf(stderr, "out of memory\n");
+      return 3;
+    }
+  }
+
+  printf("# /%d pool, /%d-/%d prefixes, %ld ops per thread%s\n",
+         BASE_MASK, MIN_LEN, MAX_LEN, nops, check ? ", checked" : "");
+  printf("# %ld online CPUs, more threads than that only time-slice\n",
+         sysconf(_SC_NPROCESSORS_ONLN));
+  printf("# threads  lock-free Mops/s  mutex+ipam Mops/s\n");
+  for (n=1; n<=max_threads; n = (n < max_threads && n * 2 > max_threads) ? max_threads : n * 2) {
+    int     whole_lf,
+            whole_mx;
+    double  lf = run(n, nops, 0, owner, &overlaps, &whole_lf),
+            mx = run(n, nops, 1, owner, &overlaps, &whole_mx);
+    printf("%9d  %16.2f  %17.2f\n", n, lf, mx);
+    if (!whole_lf || !whole_mx) {
+      printf("# pool did not merge back with %d threads\n", n);
+      ok = 0;
+    }
+  }
+  if (overlaps) {
+    printf("# %ld overlapping prefixes\n", overlaps);
+    ok = 0;
+  }
+  free(owner);
+  return ok ? 0 : 1;
+}
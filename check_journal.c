@@ -0,0 +1,222 @@
+/*********************************************************
+ * check_journal.c  --- Open, replay, torn tail and compaction of journal_t
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+/**
+ * A small pool is edited at random through the journal while the live
+ * subnets are kept in a list. After every reopen each /30 of the pool is
+ * probed, and it must be taken exactly when a live subnet covers it:
+ * replay of the logs alone, a torn record cut off the newest log, and a
+ * compaction followed by more changes, replayed from snapshot and log
+ *
+ * usage: check_journal [path]    the files path.* are overwritten and removed
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vlsm.h"
+#include "journal.h"
+
+#define BASE_MASK   22
+#define PROBE_LEN   30
+#define NLIVE       64
+#define MAX_GEN     8
+
+static int failed = 0;
+
+static const char  * path;
+static network_t     live[NLIVE];
+static int           nlive = 0;
+
+
+static void
+check (int           ok,
+       const char  * what)
+{
+  printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+  if (!ok) failed = 1;
+}
+
+
+static unsigned int
+xorshift (unsigned int * s)
+{
+  *s ^= *s << 13;
+  *s ^= *s >> 17;
+  *s ^= *s << 5;
+  return *s;
+}
+
+
+static char *
+file_name (char        * buf,
+           const char  * suffix,
+           int           gen)
+{
+  if (gen < 0) sprintf(buf, "%s.%s", path, suffix);
+  else sprintf(buf, "%s.%d.%s", path, gen, suffix);
+  return buf;
+}
+
+
+static long
+file_size (const char * name)
+{
+  FILE  * f = fopen(name, "rb");
+  long    size = -1;
+  if (f == NULL) return -1;
+  if (fseek(f, 0, SEEK_END) == 0) size = ftell(f);
+  fclose(f);
+  return size;
+}
+
+
+static void
+remove_files (void)
+{
+  char name[1024];
+  int  g;
+  remove(file_name(name, "snap", -1));
+  remove(file_name(name, "snap.tmp", -1));
+  for (g=0;g<MAX_GEN;g++) remove(file_name(name, "log", g));
+}
+
+
+/* random allocations and releases, mirrored in live[] */
+static int
+edit (journal_t     * journal,
+      unsigned int    seed,
+      int             nedits)
+{
+  int i;
+
+  for (i=0;i<nedits;i++) {
+    if (nlive < NLIVE && (nlive == 0 || xorshift(&seed) % 3 != 0)) {
+      network_t s;
+      int       r = journal_alloc(journal, (unsigned char)(25 + xorshift(&seed) % 6), i, &s);
+      if (r == 0) live[nlive++] = s;
+      else if (r != -2) return 0;
+    } else {
+      int k = (int)(xorshift(&seed) % (unsigned int)nlive);
+      if (journal_release(journal, &live[k], i) != 0) return 0;
+      live[k] = live[--nlive];
+    }
+  }
+  return 1;
+}
+
+
+/**
+ * RETURN 1 if every /PROBE_LEN of the pool is taken exactly when a live
+ * subnet covers it. A free one is taken and given back to find out
+ */
+static int
+matches (journal_t * journal)
+{
+  ipv4u32_t start = 0x0a000000U;
+  ipv4u32_t a;
+  int       k;
+
+  for (a=start; a<start + (1U << (IPV4_BITLEN - BASE_MASK)); a += 1U << (IPV4_BITLEN - PROBE_LEN)) {
+    network_t probe;
+    int       used = 0,
+              r;
+    for (k=0;k<nlive;k++) {
+      ipv4u32_t l = ipv4tou32(live[k].addr);
+      if (a >= l && a - l < 1U << (IPV4_BITLEN - live[k].mask)) used = 1;
+    }
+    u32toipv4(probe.addr, a);
+    probe.mask = PROBE_LEN;
+    r = journal_alloc_at(journal, &probe, 0);
+    if (r == 0 && journal_release(journal, &probe, 0) != 0) return 0;
+    if (used != (r == -2) || (r != 0 && r != -2)) return 0;
+  }
+  return 1;
+}
+
+
+int
+main (int     argc,
+      char  * argv[])
+{
+  journal_t     * journal;
+  network_t       base,
+                  other;
+  ipv4_t          addr = {10, 0, 0, 0};
+  char            name[1024];
+  long            size;
+  int             ok;
+
+  path = (argc > 1) ? argv[1] : "check_journal.tmp";
+  if (strlen(path) > 900) {
+    fprintf(stderr, "usage: %s [path]\n", argv[0]);
+    return 2;
+  }
+  remove_files();
+  makenetwork(&base, addr, BASE_MASK);
+
+  /* a new pool, then its log alone */
+  ok = journal_open(&journal, path, &base) == 0;
+  ok = ok && edit(journal, 1, 300);
+  check(ok, "journal_open creates a pool");
+  if (!ok) {
+    remove_files();
+    return 1;
+  }
+  journal_close(journal);
+  ok = journal_open(&journal, path, NULL) == 0 && matches(journal);
+  check(ok, "log 0 replayed without a snapshot");
+  if (ok) journal_close(journal);
+
+  /* a cut off record and a record that does not hash are both torn */
+  size = file_size(file_name(name, "log", 0));
+  {
+    FILE          * f = fopen(name, "ab");
+    unsigned char   junk[16 + 7];
+    memset(junk, 0x11, sizeof(junk));
+    ok = size > 0 && f != NULL && fwrite(junk, 1, sizeof(junk), f) == sizeof(junk);
+    if (f != NULL && fclose(f) != 0) ok = 0;
+  }
+  ok = ok && journal_open(&journal, path, NULL) == 0;
+  ok = ok && file_size(name) == size;
+  check(ok, "torn tail cut off the newest log");
+  ok = ok && matches(journal);
+  check(ok, "pool after the torn tail");
+
+  /* compaction: snapshot of the pool, changes go on in log 1 */
+  ok = ok && journal_compact(journal) == 0 && edit(journal, 2, 300);
+  if (ok) journal_close(journal);
+  ok = ok && file_size(file_name(name, "snap", -1)) > 0
+          && file_size(file_name(name, "log", 0)) < 0
+          && file_size(file_name(name, "log", 1)) > 0;
+  check(ok, "journal_compact writes the snapshot and drops log 0");
+  ok = ok && journal_open(&journal, path, &base) == 0 && matches(journal);
+  check(ok, "snapshot and log 1 replayed");
+  if (ok) journal_close(journal);
+
+  /* an existing pool over another base */
+  makenetwork(&other, addr, BASE_MASK - 1);
+  ok = journal_open(&journal, path, &other) == -2;
+  check(ok, "other base network refused");
+  if (!ok && journal != NULL) journal_close(journal);
+
+  remove_files();
+  return failed;
+}
@@ -0,0 +1,273 @@
+/*********************************************************
+ * check_snapshot.c  --- Save/load round trip of ipam_t and planner_t
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+/**
+ * A pool and a plan are built with random edits, saved, loaded back and
+ * then edited the same way as the originals, which must give the same
+ * subnets. Damaged snapshots must be refused: a node index pointing out
+ * of the file or a loop in the tree even without the checksum, a flipped
+ * byte with it, and a cut off file
+ *
+ * usage: check_snapshot [file]    the file is overwritten and removed
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vlsm.h"
+#include "ipam.h"
+#include "planner.h"
+#include "snapshot.h"
+
+#define NLIVE       200
+#define NEDITS      2000
+
+/* offset of node i in an ipam snapshot, and of its fields */
+#define NODE_OFF(i)     (SNAP_HEADERLEN + IPAM_IMAGE_WORDS * 4 + (i) * 24)
+#define NODE_PARENT     8
+#define NODE_CHILD      12
+
+static int failed = 0;
+
+
+static void
+check (int           ok,
+       const char  * what)
+{
+  printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+  if (!ok) failed = 1;
+}
+
+
+static unsigned int
+xorshift (unsigned int * s)
+{
+  *s ^= *s << 13;
+  *s ^= *s >> 17;
+  *s ^= *s << 5;
+  return *s;
+}
+
+
+static int
+same_network (const network_t  * a,
+              const network_t  * b)
+{
+  return a->mask == b->mask && (a->mask == 0 || memcmp(a->addr, b->addr, 4) == 0);
+}
+
+
+static int
+save_ipam (const ipam_t  * ipam,
+           const char    * path)
+{
+  FILE  * f = fopen(path, "wb");
+  int     r;
+  if (f == NULL) return -1;
+  r = ipam_save(ipam, f);
+  if (fclose(f) != 0) r = -1;
+  return r;
+}
+
+
+/* overwrite @len bytes at @off of @path with @data */
+static int
+patch_file (const char  * path,
+            long          off,
+            const void  * data,
+            size_t        len)
+{
+  FILE  * f = fopen(path, "r+b");
+  int     r = 0;
+  if (f == NULL) return -1;
+  if (fseek(f, off, SEEK_SET) != 0 || fwrite(data, 1, len, f) != len) r = -1;
+  if (fclose(f) != 0) r = -1;
+  return r;
+}
+
+
+/* the same random edits on two pools, RETURN 1 if they gave the same subnets */
+static int
+ipam_edit_both (ipam_t        * a,
+                ipam_t        * b,
+                network_t     * live,
+                int           * nlive,
+                unsigned int    seed,
+                int             nedits)
+{
+  int i;
+
+  for (i=0;i<nedits;i++) {
+    if (*nlive < NLIVE && (*nlive == 0 || xorshift(&seed) % 3 != 0)) {
+      unsigned char len = (unsigned char)(20 + xorshift(&seed) % 11);
+      network_t     sa,
+                    sb;
+      int           ra = ipam_alloc(a, len, &sa),
+                    rb = ipam_alloc(b, len, &sb);
+      if (ra != rb || (ra == 0 && !same_network(&sa, &sb))) return 0;
+      if (ra == 0) live[(*nlive)++] = sa;
+    } else {
+      int k = (int)(xorshift(&seed) % (unsigned int)*nlive);
+      if (ipam_release(a, &live[k]) != 0 || ipam_release(b, &live[k]) != 0) return 0;
+      live[k] = live[--*nlive];
+    }
+  }
+  return 1;
+}
+
+
+static void
+check_ipam (const char * path)
+{
+  network_t   base,
+              live[NLIVE],
+              copy[NLIVE];
+  ipv4_t      addr = {10, 20, 0, 0};
+  ipam_t    * orig,
+            * other,
+            * loaded;
+  int         nlive = 0,
+              ncopy,
+              verify,
+              ok;
+  uint32_t    bad;
+
+  makenetwork(&base, addr, 16);
+  orig = ipam_new(&base);
+  other = ipam_new(&base);
+  if (orig == NULL || other == NULL) {
+    check(0, "ipam_new");
+    return;
+  }
+  ok = ipam_edit_both(orig, other, live, &nlive, 1, NEDITS);
+  check(ok && save_ipam(orig, path) == 0, "ipam_save");
+  ncopy = nlive;
+  memcpy(copy, live, sizeof(live));
+
+  /* loaded, the pool carries on exactly like the one it was saved from */
+  for (verify=0;verify<2;verify++) {
+    nlive = ncopy;
+    memcpy(live, copy, sizeof(live));
+    ok = ipam_load(&loaded, path, verify) == 0;
+    if (ok) {
+      /* orig and other were both at the saved state, each is used once */
+      ok = ipam_edit_both(loaded, verify ? other : orig, live, &nlive, 2, NEDITS);
+      ipam_free(loaded);
+    }
+    check(ok, verify ? "ipam_load with verify, then edits" : "ipam_load, then edits");
+  }
+
+  /* damaged files */
+  check(save_ipam(orig, path) == 0, "ipam_save after edits");
+  bad = 0x7fffffffU;
+  ok = patch_file(path, NODE_OFF(0) + NODE_CHILD, &bad, 4) == 0
+    && ipam_load(&loaded, path, 0) == -2;
+  check(ok, "child index out of the file refused without verify");
+
+  check(save_ipam(orig, path) == 0, "ipam_save again");
+  /* the root's halves are nodes 1 and 2, point the right one up at itself */
+  bad = 2;
+  ok = patch_file(path, NODE_OFF(2) + NODE_PARENT, &bad, 4) == 0
+    && ipam_load(&loaded, path, 0) == -2;
+  check(ok, "loop in the tree refused without verify");
+
+  check(save_ipam(orig, path) == 0, "ipam_save again");
+  {
+    unsigned char byte = 0x5a;
+    ok = patch_file(path, NODE_OFF(1) + 0, &byte, 1) == 0
+      && ipam_load(&loaded, path, 1) == -2;
+    check(ok, "flipped byte refused with verify");
+  }
+
+  check(save_ipam(orig, path) == 0, "ipam_save again");
+  {
+    FILE * f = fopen(path, "r+b");
+    char   head[SNAP_HEADERLEN + 8];
+    ok = f != NULL && fread(head, 1, sizeof(head), f) == sizeof(head);
+    if (f != NULL) fclose(f);
+    f = fopen(path, "wb");
+    ok = ok && f != NULL && fwrite(head, 1, sizeof(head), f) == sizeof(head);
+    if (f != NULL) fclose(f);
+    check(ok && ipam_load(&loaded, path, 0) == -2, "cut off file refused");
+  }
+
+  ipam_free(orig);
+  ipam_free(other);
+}
+
+
+static void
+check_planner (const char * path)
+{
+  ipv4_t            addr = {172, 16, 0, 0};
+  planner_t       * orig,
+                  * loaded = NULL;
+  unsigned long     nhosts[64];
+  planner_change_t  changes[64];
+  unsigned int      seed = 7;
+  int               nchanges,
+                    i,
+                    ok;
+  FILE            * f;
+
+  orig = planner_new(addr, 20);
+  if (orig == NULL) {
+    check(0, "planner_new");
+    return;
+  }
+  for (i=0;i<40;i++) planner_add(orig, xorshift(&seed) % 60, NULL);
+  for (i=0;i<10;i++) planner_remove(orig, (int)(xorshift(&seed) % 40), NULL);
+
+  f = fopen(path, "wb");
+  ok = f != NULL && planner_save(orig, f) == 0;
+  if (f != NULL && fclose(f) != 0) ok = 0;
+  check(ok, "planner_save");
+
+  ok = ok && planner_load(&loaded, path, 1) == 0
+          && planner_count(loaded) == planner_count(orig);
+  for (i=0;ok && i<planner_count(orig);i++) {
+    ok = same_network(planner_subnet(orig, i), planner_subnet(loaded, i));
+  }
+  check(ok, "planner_load gives the same subnets");
+
+  /* edits on the mapped plan, arrays and pool move to the heap */
+  for (i=0;i<64;i++) nhosts[i] = xorshift(&seed) % 30;
+  ok = ok && planner_update(orig, nhosts, 64, changes, &nchanges) == 0
+          && planner_update(loaded, nhosts, 64, changes, &nchanges) == 0
+          && planner_count(loaded) == planner_count(orig);
+  for (i=0;ok && i<planner_count(orig);i++) {
+    ok = same_network(planner_subnet(orig, i), planner_subnet(loaded, i));
+  }
+  check(ok, "planner_update on a loaded plan");
+
+  planner_free(loaded);
+  planner_free(orig);
+}
+
+
+int
+main (int     argc,
+      char  * argv[])
+{
+  const char * path = (argc > 1) ? argv[1] : "check_snapshot.tmp";
+
+  check_ipam(path);
+  check_planner(path);
+  remove(path);
+  return failed;
+}
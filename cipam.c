@@ -0,0 +1,268 @@
+/*********************************************************
+ * cipam.c  --- Lock-free prefix allocator of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "vlsm.h"
+#include "cipam.h"
+
+/**
+ * Level l holds the blocks of prefix length l, block i of it starts at
+ * root + i * 2^(32-l). A set bit is a FREE block. Set bits never overlap:
+ * a thread owns whatever bits it cleared, and sets bits only for blocks it
+ * owns. nfree and hint are only hints for the search
+ *
+ * Between clearing a block and setting the bits of its halves (a split)
+ * or of its parent (a merge) the space is in no bitmap. transit counts
+ * the blocks in that state and puts changes whenever bits are set, so a
+ * search that found nothing can tell whether it has to look again
+ */
+typedef struct
+{
+  uint64_t        * bits;
+  size_t            nwords;
+  long              nfree;
+  size_t            hint;     /* word where a block was last found or freed */
+  char              pad[32];  /* keep hot levels on their own cache line */
+} clevel_t;
+
+struct cipam
+{
+  ipv4u32_t         root;     /* smallest aligned block that covers the pool */
+  unsigned char     root_len,
+                    base_len,
+                    max_len;
+  uint64_t          start,    /* the base network is [start,end) */
+                    end;
+  uint64_t        * words;
+  long              transit;  /* blocks taken but not yet put back */
+  unsigned long     puts;     /* changes after every level_put() */
+  clevel_t          level[IPV4_BITLEN + 1];
+};
+
+#define WORD_BIT(i)   ((uint64_t)1 << ((i) & 63))
+
+
+/* mark a block about to be cleared as in transit, or one put back as not */
+#define TRANSIT_ADD(c)  __atomic_fetch_add(&(c)->transit, 1, __ATOMIC_SEQ_CST)
+#define TRANSIT_SUB(c)  __atomic_fetch_sub(&(c)->transit, 1, __ATOMIC_SEQ_CST)
+
+
+/**
+ * clear one set bit of level l, the block stays in transit until the
+ * caller puts it back. Return 0 if none was found
+ */
+static int
+level_take (cipam_t    * cipam,
+            clevel_t   * lv,
+            size_t     * idx)
+{
+  size_t w = __atomic_load_n(&lv->hint, __ATOMIC_RELAXED),
+         k;
+
+  for (k=0;k<lv->nwords;k++, w++) {
+    uint64_t bits;
+    if (w >= lv->nwords) w = 0;
+    bits = __atomic_load_n(&lv->bits[w], __ATOMIC_ACQUIRE);
+    if (bits == 0) continue;
+    TRANSIT_ADD(cipam);
+    while (bits != 0) {
+      int b = __builtin_ctzll(bits);
+      if (__atomic_compare_exchange_n(&lv->bits[w], &bits, bits & ~((uint64_t)1 << b), 1,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      {
+        __atomic_fetch_sub(&lv->nfree, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&lv->hint, w, __ATOMIC_RELAXED);
+        *idx = w * 64 + b;
+        return 1;
+      }
+    }
+    TRANSIT_SUB(cipam);
+  }
+  return 0;
+}
+
+
+/* mark block idx of level l FREE, its buddy is known not to be FREE */
+static void
+level_put (cipam_t    * cipam,
+           clevel_t   * lv,
+           size_t       idx)
+{
+  __atomic_fetch_or(&lv->bits[idx / 64], WORD_BIT(idx), __ATOMIC_ACQ_REL);
+  __atomic_fetch_add(&lv->nfree, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&lv->hint, idx / 64, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&cipam->puts, 1, __ATOMIC_SEQ_CST);
+}
+
+
+cipam_t *
+cipam_new (const network_t   * base,
+           unsigned char       max_len)
+{
+  cipam_t   * cipam;
+  uint64_t    a;
+  size_t      nwords = 0;
+  int         order = 0,
+              l;
+
+  if (base->mask > IPV4_BITLEN || max_len > IPV4_BITLEN || max_len < base->mask) return NULL;
+  cipam = (cipam_t *) calloc (1, sizeof(cipam_t));
+  if (cipam == NULL) return NULL;
+
+  cipam->base_len = base->mask;
+  cipam->max_len = max_len;
+  cipam->start = ipv4tonet32(ipv4tou32(base->addr), base->mask);
+  cipam->end = cipam->start + ((uint64_t)1 << (IPV4_BITLEN - base->mask));
+  if (cipam->end > (uint64_t)1 << IPV4_BITLEN) cipam->end = (uint64_t)1 << IPV4_BITLEN;
+  while ((cipam->start >> order) != ((cipam->end - 1) >> order)) order++;
+  cipam->root = (ipv4u32_t)((cipam->start >> order) << order);
+  cipam->root_len = (unsigned char)(IPV4_BITLEN - order);
+
+  for (l=cipam->root_len;l<=max_len;l++) {
+    size_t nbits = (size_t)1 << (l - cipam->root_len);
+    cipam->level[l].nwords = (nbits + 63) / 64;
+    nwords += cipam->level[l].nwords;
+  }
+  cipam->words = (uint64_t *) calloc (nwords, sizeof(uint64_t));
+  if (cipam->words == NULL) {
+    cipam_free(cipam);
+    return NULL;
+  }
+  nwords = 0;
+  for (l=cipam->root_len;l<=max_len;l++) {
+    cipam->level[l].bits = cipam->words + nwords;
+    nwords += cipam->level[l].nwords;
+  }
+
+  /* [start,end) as aligned blocks, too small ones cannot be used */
+  for (a=cipam->start; a<cipam->end; ) {
+    int o = 0;
+    while (o < IPV4_BITLEN && !((a >> o) & 1)) o++;
+    while (a + ((uint64_t)1 << o) > cipam->end) o--;
+    l = IPV4_BITLEN - o;
+    if (l <= max_len) level_put(cipam, &cipam->level[l], (size_t)((a - cipam->root) >> o));
+    a += (uint64_t)1 << o;
+  }
+  return cipam;
+}
+
+
+void
+cipam_free (cipam_t * cipam)
+{
+  if (cipam == NULL) return;
+  free(cipam->words);
+  free(cipam);
+}
+
+
+int
+cipam_alloc (cipam_t         * cipam,
+             unsigned char     prefix_len,
+             network_t       * subnet)
+{
+  size_t          idx;
+  unsigned long   puts;
+  int             l;
+
+  if (prefix_len < cipam->base_len || prefix_len > cipam->max_len) return -1;
+
+  /* the smallest FREE block that holds it */
+  for (;;) {
+    puts = __atomic_load_n(&cipam->puts, __ATOMIC_SEQ_CST);
+    for (l=prefix_len; l>=cipam->root_len; l--) {
+      if (__atomic_load_n(&cipam->level[l].nfree, __ATOMIC_RELAXED) > 0
+       && level_take(cipam, &cipam->level[l], &idx))
+      {
+        break;
+      }
+    }
+    if (l >= cipam->root_len) break;
+    /* the pool is full only if no block was in transit or put back meanwhile */
+    if (__atomic_load_n(&cipam->transit, __ATOMIC_SEQ_CST) == 0
+     && __atomic_load_n(&cipam->puts, __ATOMIC_SEQ_CST) == puts)
+    {
+      return -2;
+    }
+  }
+
+  /* keep the left half, the right halves become FREE */
+  for (; l<prefix_len; l++) {
+    idx *= 2;
+    level_put(cipam, &cipam->level[l + 1], idx + 1);
+  }
+  TRANSIT_SUB(cipam);
+  u32toipv4(subnet->addr, cipam->root + (ipv4u32_t)((uint64_t)idx << (IPV4_BITLEN - prefix_len)));
+  subnet->mask = prefix_len;
+  return 0;
+}
+
+
+int
+cipam_release (cipam_t            * cipam,
+               const network_t    * subnet)
+{
+  uint64_t  addr = ipv4tou32(subnet->addr);
+  size_t    idx;
+  int       l = subnet->mask;
+
+  if (l < cipam->base_len || l > cipam->max_len || l < cipam->root_len
+   || (addr & ~(uint64_t)masktou32(l) & 0xffffffffU) != 0
+   || addr < cipam->start || addr + ((uint64_t)1 << (IPV4_BITLEN - l)) > cipam->end)
+  {
+    return -1;
+  }
+  idx = (size_t)((addr - cipam->root) >> (IPV4_BITLEN - l));
+
+  /* a merge takes the buddy out of its bitmap until the parent is put */
+  TRANSIT_ADD(cipam);
+  for (;;) {
+    clevel_t  * lv = &cipam->level[l];
+    uint64_t  * word = &lv->bits[idx / 64];
+    uint64_t    mine = WORD_BIT(idx),
+                buddy = WORD_BIT(idx ^ 1),
+                bits = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+    int         merged;
+
+    for (;;) {
+      if (bits & mine) {
+        TRANSIT_SUB(cipam);
+        return -1;
+      }
+      merged = (l > cipam->root_len && (bits & buddy));
+      if (__atomic_compare_exchange_n(word, &bits, merged ? bits & ~buddy : bits | mine, 1,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      {
+        break;
+      }
+    }
+    if (!merged) {
+      __atomic_fetch_add(&lv->nfree, 1, __ATOMIC_RELAXED);
+      __atomic_store_n(&lv->hint, idx / 64, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&cipam->puts, 1, __ATOMIC_SEQ_CST);
+      TRANSIT_SUB(cipam);
+      return 0;
+    }
+
+    /* took the FREE buddy, free the parent instead */
+    __atomic_fetch_sub(&lv->nfree, 1, __ATOMIC_RELAXED);
+    idx /= 2;
+    l--;
+  }
+}
@@ -0,0 +1,83 @@
+/*********************************************************
+ * cipam.h  --- Lock-free prefix allocator of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef CIPAM_H
+#define CIPAM_H
+
+#include "vlsm.h"
+
+/**
+ * a base network shared by many threads as a pool of prefixes, the
+ * concurrent sibling of ipam_t. There is no lock: every prefix length has
+ * a bitmap of its free blocks and blocks are taken and given back with a
+ * compare-and-swap on one 64-bit word. A block and its buddy share a word,
+ * so freeing one merges it with a free buddy in the same step
+ * Needs gcc atomic builtins
+ */
+typedef struct cipam cipam_t;
+
+
+/**
+ * create a pool over the base network @base (host bits of its address
+ * cleared), the same address space vlsm() uses. @max_len is the longest
+ * prefix that will be allocated; the bitmaps take about
+ * 2^(@max_len - mask) / 4 bytes
+ * Return NULL if the masks are invalid or out of memory
+ */
+cipam_t             * cipam_new           (const network_t        * base,
+                                           unsigned char            max_len);
+
+
+/**
+ * no other thread may use @cipam any more
+ */
+void                  cipam_free          (cipam_t                * cipam);
+
+
+/**
+ * allocate a prefix of length @prefix_len. Safe to call from any thread
+ * Return:
+ *    0  : Successful, the prefix is stored to @subnet
+ *   -1  : @prefix_len is shorter than the base mask or longer than max_len
+ *   -2  : no free block that large. A block another thread is splitting
+ *         or merging is waited for, so this is not a transient failure
+ */
+int                   cipam_alloc         (cipam_t                * cipam,
+                                           unsigned char            prefix_len,
+                                           network_t              * subnet);
+
+
+/**
+ * give back @subnet, a prefix returned by cipam_alloc(). Safe to call from
+ * any thread, but a prefix must be released only once; releasing it twice
+ * is caught only while it has not been merged with its buddy
+ * Return: 0 if Successful, -1 if @subnet cannot be a prefix of the pool
+ *         or is already free
+ */
+int                   cipam_release       (cipam_t                * cipam,
+                                           const network_t        * subnet);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
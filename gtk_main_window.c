@@ -25,6 +25,7 @@
 
 #include "gtk_main_window.h"
 #include "vlsm.h"
+#include "stats.h"
 
 /*** PROTOTYPES ***/
 static void vlsm_update_view (MainWindow *);
@@ -124,7 +125,7 @@ static void mask_in_activate_handler (GtkEntry *entry, MainWindow *mw)
 
 
 /**
- * Input filter (accept only numberic char and .)
+ * Input filter (accept only numberic char and . , or the chars in data)
  * copied from GTK+ FAQ with a few changes
  */
 static void insert_text_handler (GtkEntry    *entry,
@@ -135,10 +136,11 @@ static void insert_text_handler (GtkEntry    *entry,
 {
   GtkEditable *editable = GTK_EDITABLE(entry);
   int i, count=0;
+  const gchar *accept = data ? (const gchar *) data : ".,";
   gchar *result = g_new (gchar, length);
 
   for (i=0; i < length; i++) {
-    if (!(isdigit(text[i]) || text[i] == '.' || text[i] == ',') )
+    if (!(isdigit(text[i]) || (text[i] != '\0' && strchr(accept, text[i]) != NULL)) )
       continue;
     result[count++] = text[i];
   }
@@ -158,6 +160,68 @@ static void insert_text_handler (GtkEntry    *entry,
 }
 
 
+/* what host_in takes besides digits, see vlsm_parse_hosts() */
+#define HOSTS_CHARS     ".,xX \t\r\n"
+
+/* how often status_label shows the progress of a solve, in ms */
+#define PROGRESS_MS     100
+
+/**
+ * One solve running in the worker thread. Until it is handed back by
+ * solve_done() the worker owns mw->planner, mw->ws and mw->changes, and
+ * the main thread keeps its hands off them
+ */
+struct solve_job
+{
+  MainWindow *mw;
+  gchar *input; // copy of host_in
+  gint len;
+  volatile gint cancel; // set by the main thread to stop the worker
+  volatile gint placing; // parsing is done, placing subnets
+  int n, nchanges; // results: subnets, subnets changed
+  int error; // 0, -2 does not fit, -3 out of memory
+  int bad_hosts; // vlsm_parse_hosts() error at errpos of input, 0 if none
+  size_t errpos;
+};
+
+/**
+ * ask the worker to stop and wait for it. Nothing of the plan is left
+ * half changed: planner_update() is never stopped in the middle
+ */
+static void stop_solve (MainWindow *mw)
+{
+  if (mw->job != NULL) {
+    g_atomic_int_set(&mw->job->cancel, 1);
+    g_thread_join(mw->worker);
+    g_idle_remove_by_data(mw->job); // its solve_done(), if queued already
+    g_free(mw->job->input);
+    g_free(mw->job);
+    mw->job = NULL;
+    mw->worker = NULL;
+  }
+  if (mw->progress_id != 0) {
+    g_source_remove(mw->progress_id);
+    mw->progress_id = 0;
+  }
+}
+
+/**
+ * make subnet_tree show the first @n subnets of mw->ws, or nothing if @n
+ * is 0. It must show nothing before the worker may change mw->ws
+ * Return: 0 if Successful, -3 out of memory
+ */
+static int show_subnets (MainWindow *mw, int n)
+{
+  int ret;
+
+  /* off the view while it changes, the view then asks for the rows it
+   * shows again instead of being told of every row */
+  gtk_tree_view_set_model(GTK_TREE_VIEW(mw->subnet_tree), NULL);
+  ret = subnet_model_set(mw->subnet_store, mw->ws.subnets, mw->ws.nhosts, n);
+  gtk_tree_view_set_model(GTK_TREE_VIEW(mw->subnet_tree), GTK_TREE_MODEL(mw->subnet_store));
+  return ret;
+}
+
 /**
  * Handler for host_in  clicked signal
  * call vlsm_update_view()
@@ -167,6 +231,17 @@ static void host_in_activate_handler (GtkEntry *entry, MainWindow *mw)
   vlsm_update_view(mw);
 }
 
+/**
+ * Handler for host_in changed signal
+ * the solve running is for the old input, cancel it
+ */
+static void host_in_changed_handler (GtkEntry *entry, MainWindow *mw)
+{
+  if (mw->job == NULL) return;
+  stop_solve(mw);
+  gtk_label_set_text(GTK_LABEL(mw->status_label), "VLSM cancelled");
+}
+
 /**
  * Handler for subnet_button  clicked signal
  * call vlsm_update_view()
@@ -182,32 +257,187 @@ static void subnet_button_clicked_handler (GtkButton *button, MainWindow *mw)
  */
 static void reset_button_clicked_handler (GtkButton *button, MainWindow *mw)
 {
-  gtk_list_store_clear(mw->subnet_store);
+  stop_solve(mw);
+  show_subnets(mw, 0);
+  planner_free(mw->planner);
+  mw->planner = NULL;
   gtk_entry_set_text(GTK_ENTRY(mw->host_in), "");
   gtk_label_set_text(GTK_LABEL(mw->status_label), "Programmed by Nelson Chan");
 }
 
 
 /**
- * Function that perform VLSM and update ListStore/Treeview
- * intended to be called by other handlers
+ * make mw->ws hold at least @n requirements, keeping the first @keep, and
+ * mw->changes at least @nchanges. Both only grow, by doubling, so a window
+ * solving again and again stops allocating after the first few solves
+ * Return: 0 if out of memory
+ */
+static int ws_reserve (MainWindow *mw, int n, int keep, int nchanges)
+{
+  int cap = mw->ws.cap ? mw->ws.cap : 16;
+  void *mem;
+
+  if (n > mw->ws.cap) {
+    while (cap < n) cap = (cap > G_MAXINT / 2) ? G_MAXINT : cap * 2;
+    STATS_MALLOC(vlsm_ws_size(cap));
+    mem = g_try_malloc(vlsm_ws_size(cap));
+    if (mem == NULL) return 0;
+    if (keep > 0) memcpy(mem, mw->ws.nhosts, sizeof(unsigned long) * keep);
+    g_free(mw->ws_mem);
+    mw->ws_mem = mem;
+    vlsm_ws_init(&mw->ws, mem, vlsm_ws_size(cap));
+  }
+  if (nchanges > mw->changes_cap) {
+    cap = mw->changes_cap ? mw->changes_cap : 16;
+    while (cap < nchanges) cap = (cap > G_MAXINT / 2) ? G_MAXINT : cap * 2;
+    STATS_MALLOC(sizeof(planner_change_t) * cap);
+    mem = g_try_realloc(mw->changes, sizeof(planner_change_t) * cap);
+    if (mem == NULL) return 0;
+    mw->changes = (planner_change_t *) mem;
+    mw->changes_cap = cap;
+  }
+  return 1;
+}
+
+
+/**
+ * the main thread half of a finished solve: show the error or the result
+ */
+static gboolean solve_done (gpointer data)
+{
+  struct solve_job *job = (struct solve_job *) data;
+  MainWindow *mw = job->mw;
+  char status[224],
+       stats[160];
+
+  g_thread_join(mw->worker);
+  mw->worker = NULL;
+  mw->job = NULL;
+  g_source_remove(mw->progress_id);
+  mw->progress_id = 0;
+
+  if (job->error == 0 && job->n > 0) {
+    STATS_BEGIN(t_format);
+    if (show_subnets(mw, job->n) != 0) job->error = -3;
+    STATS_END(STATS_FORMAT, t_format);
+  }
+  if (job->bad_hosts != 0) {
+    sprintf(status, "<span color='red'>Error: %s at character %lu</span>",
+            (job->bad_hosts == -1) ? "invalid number of hosts" : "too many hosts",
+            (unsigned long) job->errpos + 1);
+    gtk_label_set_markup(GTK_LABEL(mw->status_label), status);
+    gtk_widget_grab_focus(mw->host_in);
+    gtk_editable_select_region(GTK_EDITABLE(mw->host_in), job->errpos, job->errpos + 1);
+  } else if (job->error == -3) {
+    gtk_label_set_markup(GTK_LABEL(mw->status_label), "<span color='red'>Error: out of memory</span>");
+  } else if (job->error < 0) {
+    gtk_label_set_markup(GTK_LABEL(mw->status_label), "<span color='red'>Error: the subnets do not fit in the base network</span>");
+  } else if (job->n > 0) {
+    /* misc, with the numbers of this solve if --stats */
+    stats_summary(stats, sizeof(stats));
+    if (stats[0] != '\0') {
+      snprintf(status, sizeof(status), "VLSM successul! %d subnets changed (%s)", job->nchanges, stats);
+    } else {
+      sprintf(status, "VLSM successul! %d subnets changed", job->nchanges);
+    }
+    gtk_label_set_text(GTK_LABEL(mw->status_label), status);
+  } else {
+    /* host_in held separators only */
+    gtk_label_set_text(GTK_LABEL(mw->status_label), "VLSM: no subnets");
+  }
+  g_free(job->input);
+  g_free(job);
+  return FALSE;
+}
+
+/**
+ * the worker thread: parse the host numbers of @data into mw->ws, update
+ * the plan and copy its subnets to mw->ws, then hand the job back to the
+ * main loop. Stops early if cancelled
+ */
+static gpointer solve_thread (gpointer data)
+{
+  struct solve_job *job = (struct solve_job *) data;
+  MainWindow       *mw = job->mw;
+  int               i,
+                    n_arrc; // element counter for ws.nhosts
+  STATS_BEGIN(t_job);
+  STATS_BEGIN(t_parse);
+
+  /* parse host_in to ws.nhosts, again if they did not fit */
+  n_arrc = vlsm_parse_hosts(mw->ws.nhosts, mw->ws.cap, job->input, job->len, &job->errpos);
+  if (n_arrc < 0) {
+    job->bad_hosts = n_arrc;
+    goto done;
+  }
+  if (n_arrc > 0 && mw->plan_mask > 0
+   && (guint64)n_arrc > ((guint64)1 << (IPV4_BITLEN - mw->plan_mask)))
+  {
+    job->error = -2; // more subnets than addresses, do not make room for them
+    goto done;
+  }
+  if (n_arrc > mw->ws.cap) {
+    if (!ws_reserve(mw, n_arrc, 0, 0)) {
+      job->error = -3;
+      goto done;
+    }
+    vlsm_parse_hosts(mw->ws.nhosts, mw->ws.cap, job->input, job->len, NULL);
+  }
+  if (n_arrc == 0 || g_atomic_int_get(&job->cancel)) goto done;
+  STATS_END(STATS_PARSE, t_parse);
+  g_atomic_int_set(&job->placing, 1);
+
+  /* update the plan */
+  if (!ws_reserve(mw, n_arrc, n_arrc, MAX(n_arrc, planner_count(mw->planner)))) {
+    job->error = -3;
+    goto done;
+  }
+  job->error = planner_update (mw->planner, mw->ws.nhosts, n_arrc, mw->changes, &job->nchanges);
+  if (job->error < 0) goto done;
+  for (i=0;i<n_arrc;i++) {
+    mw->ws.subnets[i] = *planner_subnet(mw->planner, i);
+  }
+  job->n = n_arrc;
+  STATS_JOB(t_job);
+
+done:
+  g_idle_add(solve_done, job);
+  return NULL;
+}
+
+/**
+ * status_label shows how far the worker is
+ */
+static gboolean show_progress (gpointer data)
+{
+  MainWindow *mw = (MainWindow *) data;
+  char status[64];
+
+  if (g_atomic_int_get(&mw->job->placing)) {
+    sprintf(status, "VLSM: placing subnets...");
+  } else {
+    sprintf(status, "VLSM: reading host numbers...");
+  }
+  gtk_label_set_text(GTK_LABEL(mw->status_label), status);
+  return TRUE;
+}
+
+/**
+ * Function that perform VLSM and update the model/Treeview
+ * intended to be called by other handlers. The solve runs in a worker
+ * thread, a solve still running is cancelled first
  */
 static void vlsm_update_view(MainWindow *mw)
 {
-  unsigned long    * n_arr = NULL;
   const gchar      * input;
-  char             * tmpstr;
-  network_t        * subnets;
-  int                i,
-                     n_arrc; // element counter for n_arr
+  struct solve_job * job;
   unsigned char      smask;
-  guint16            in_length;
-  ipv4_t             addr,
-                     tmpaddr;
-  networkstr_t       ipstr[NUM_COLS];
-  GtkTreeIter        iter;
+  ipv4_t             addr;
+
   /* reset store */
-  gtk_list_store_clear(mw->subnet_store);
+  stop_solve(mw);
+  show_subnets(mw, 0);
+  stats_reset();
 
   /* activate the network entires */
   update_net(NULL,mw);
@@ -217,90 +447,34 @@ static void vlsm_update_view(MainWindow *mw)
   input = gtk_entry_get_text (GTK_ENTRY(mw->smask_in));
   smask = (unsigned char) atoi (input);
 
-  /* parse host_in to unsigned long array */
-  input = gtk_entry_get_text(GTK_ENTRY(mw->host_in));
-  in_length = gtk_entry_get_text_length(GTK_ENTRY(mw->host_in));
-  if (in_length == 0) return; // do nothing
-  in_length += 1; // count the \0
-  tmpstr = (char *)g_malloc(in_length * sizeof(char) +10); //add room for COL_NAME text and \0
-  sprintf(tmpstr,"%s","");
-
-  // really parse now...
-  n_arrc = 0;
-  for (i=0;i<in_length;i++) {
-    if (input[i] == ',' || input[i] == '.' || input[i] == '\0') {
-      /* we got ',' or '.' or \0 , now parse the number before it*/
-      if (strlen(tmpstr) == 0) continue; // this happen when user enter like ",,123"
-      n_arrc += 1;
-      n_arr = (unsigned long *) g_realloc (n_arr,sizeof(unsigned long) * n_arrc);
-      n_arr[n_arrc-1] = (unsigned long) atol (tmpstr);
-      printf("# input: %s  -> %lu\n",tmpstr, n_arr[n_arrc-1]);
-      sprintf(tmpstr,"%s","");
-    } else {
-      sprintf(tmpstr,"%s%c",tmpstr,input[i]);
-    }
+  /* host_in, parsed by the worker */
+  if (gtk_entry_get_text_length(GTK_ENTRY(mw->host_in)) == 0) return; // do nothing
+
+  /* keep the plan between updates so subnets keep their addresses,
+   * only a new base network starts over */
+  if (mw->planner == NULL || mw->plan_addr != ipv4tou32(addr) || mw->plan_mask != smask) {
+    planner_free(mw->planner);
+    mw->planner = planner_new(addr, smask);
+    mw->plan_addr = ipv4tou32(addr);
+    mw->plan_mask = smask;
   }
-  printf("# n_arrc=%d\n",n_arrc);
-  if (n_arrc == 0) return; // no number entered, nothing to do
-
-  /* call vlsm() */
-  subnets = (network_t *) g_malloc (sizeof(network_t) * n_arrc );
-  i = vlsm (subnets, addr, smask, n_arr, n_arrc); // we could make use of error code from vlsm()
-  if (i == -2) {
-    gtk_label_set_markup(GTK_LABEL(mw->status_label), "<span color='red'>Error: no host or too many hosts to address for the base network</span>");
+  if (mw->planner == NULL) {
+    gtk_label_set_markup(GTK_LABEL(mw->status_label), "<span color='red'>Error: invalid net mask</span>");
     return;
   }
-  for (i=0;i<n_arrc;i++)
-      print_network(&subnets[i]);
-
 
-  /* append new data to store */
-  for (i=0;i<n_arrc;i++) {
-    // Name
-    if (n_arr[i] == 0) {
-      //sprintf(tmpstr,"ERROR");
-      continue;  // hide it
-    } else {
-      sprintf(tmpstr,"Subnet %lu", n_arr[i]); // tmpstr be subnet name
-    }
-    // Addr
-    ipv4tostr (ipstr[COL_ADDR], subnets[i].addr);
-    sprintf (ipstr[COL_ADDR],"%s /%u",ipstr[COL_ADDR],subnets[i].mask);
-    // DMASK
-    masktodot (tmpaddr,subnets[i].mask);
-    ipv4tostr (ipstr[COL_DMASK], tmpaddr);
-    // FHOST
-    calfirst(tmpaddr,subnets[i].addr, subnets[i].mask);
-    ipv4tostr(ipstr[COL_FHOST], tmpaddr);
-    // LHOST
-    callast (tmpaddr, subnets[i].addr, subnets[i].mask);
-    ipv4tostr (ipstr[COL_LHOST], tmpaddr);
-    // BCAST
-    calbroadcast (tmpaddr, subnets[i].addr, subnets[i].mask);
-    ipv4tostr (ipstr[COL_BCAST], tmpaddr);
-
-    /* set data */
-    gtk_list_store_append (mw->subnet_store, &iter);
-    gtk_list_store_set (mw->subnet_store, &iter,
-                        COL_NAME,  tmpstr,
-                        COL_ADDR,  ipstr[COL_ADDR],
-                        COL_DMASK, ipstr[COL_DMASK],
-                        COL_FHOST, ipstr[COL_FHOST],
-                        COL_LHOST, ipstr[COL_LHOST],
-                        COL_BCAST, ipstr[COL_BCAST],
-                        -1);
-    //
-  }
-
-  /* free memory */
-  g_free(tmpstr);
-  g_free(n_arr);
-  g_free(subnets);
-
-  /* misc */
-  gtk_label_set_text(GTK_LABEL(mw->status_label), "VLSM successul!");
+  /* start the worker */
+  job = g_new0(struct solve_job, 1);
+  job->mw = mw;
+  job->input = g_strdup(gtk_entry_get_text(GTK_ENTRY(mw->host_in)));
+  job->len = strlen(job->input);
+  mw->job = job;
+  mw->worker = g_thread_new("vlsm", solve_thread, job);
+  mw->progress_id = g_timeout_add(PROGRESS_MS, show_progress, mw);
+  gtk_label_set_text(GTK_LABEL(mw->status_label), "VLSM: solving...");
 }
 
+
 /**
  * Here we build the main layout of the window. That
  * means initializing main box and frames. And then
@@ -416,67 +590,46 @@ static void button_build(MainWindow *mw)
  */
 static void tree_build(MainWindow *mw)
 {
-  /* init the store */
-  mw->subnet_store = gtk_list_store_new (NUM_COLS,
-                                         G_TYPE_STRING,
-                                         G_TYPE_STRING,
-                                         G_TYPE_STRING,
-                                         G_TYPE_STRING,
-                                         G_TYPE_STRING,
-                                         G_TYPE_STRING
-                                         );
-
-  /* init the view */
+  static const char * const titles[NUM_COLS] = {
+    "Name", "Address", "Mask", "First Host", "Last Host", "Broadcast"
+  };
+  static const char * const widest[NUM_COLS] = { // longest text of each column
+    "Subnet 4294967295", "255.255.255.255 /32", "255.255.255.255",
+    "255.255.255.255", "255.255.255.255", "255.255.255.255"
+  };
   GtkCellRenderer *cell_renderer;
+  GtkTreeViewColumn *column;
+  PangoLayout *layout;
+  int i, width, title_width;
+
+  /* init the model */
+  mw->subnet_store = subnet_model_new();
+
+  /* init the view, scrolled by itself so it only draws the rows in sight */
   mw->scroll_win = gtk_scrolled_window_new(NULL, NULL);
   mw->subnet_tree = gtk_tree_view_new();
-  gtk_scrolled_window_add_with_viewport(GTK_SCROLLED_WINDOW(mw->scroll_win),
-                                        mw->subnet_tree);
+  gtk_container_add(GTK_CONTAINER(mw->scroll_win), mw->subnet_tree);
   gtk_box_pack_start(GTK_BOX(mw->subnet_box), mw->scroll_win, TRUE, TRUE, 0);
 
-  /* view's columns */
-  cell_renderer = gtk_cell_renderer_text_new();
-  gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW(mw->subnet_tree),
-                                               -1,
-                                               "Name",
-                                               cell_renderer,
-                                               "text", COL_NAME,
-                                               NULL);
-  cell_renderer = gtk_cell_renderer_text_new();
-  gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW(mw->subnet_tree),
-                                               -1,
-                                               "Address",
-                                               cell_renderer,
-                                               "text", COL_ADDR,
-                                               NULL);
-  cell_renderer = gtk_cell_renderer_text_new();
-  gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW(mw->subnet_tree),
-                                               -1,
-                                               "Mask",
-                                               cell_renderer,
-                                               "text", COL_DMASK,
-                                               NULL);
-  cell_renderer = gtk_cell_renderer_text_new();
-  gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW(mw->subnet_tree),
-                                               -1,
-                                               "First Host",
-                                               cell_renderer,
-                                               "text", COL_FHOST,
-                                               NULL);
-  cell_renderer = gtk_cell_renderer_text_new();
-  gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW(mw->subnet_tree),
-                                               -1,
-                                               "Last Host",
-                                               cell_renderer,
-                                               "text", COL_LHOST,
-                                               NULL);
-  cell_renderer = gtk_cell_renderer_text_new();
-  gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW(mw->subnet_tree),
-                                               -1,
-                                               "Broadcast",
-                                               cell_renderer,
-                                               "text", COL_BCAST,
-                                               NULL);
+  /* view's columns, of fixed width and row height so the view never has
+   * to measure every row */
+  for (i=0;i<NUM_COLS;i++) {
+    cell_renderer = gtk_cell_renderer_text_new();
+    column = gtk_tree_view_column_new_with_attributes(titles[i], cell_renderer,
+                                                      "text", i,
+                                                      NULL);
+    layout = gtk_widget_create_pango_layout(mw->subnet_tree, widest[i]);
+    pango_layout_get_pixel_size(layout, &width, NULL);
+    pango_layout_set_text(layout, titles[i], -1);
+    pango_layout_get_pixel_size(layout, &title_width, NULL);
+    g_object_unref(layout);
+    gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+    gtk_tree_view_column_set_fixed_width(column, MAX(width, title_width) + 16);
+    gtk_tree_view_column_set_resizable(column, TRUE);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(mw->subnet_tree), column);
+  }
+  gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(mw->subnet_tree), TRUE);
+
   /* connect tree model */
   gtk_tree_view_set_model(GTK_TREE_VIEW(mw->subnet_tree), GTK_TREE_MODEL(mw->subnet_store));
 }
@@ -499,8 +652,9 @@ static void connect_signals(MainWindow *mw)
   g_signal_connect(G_OBJECT(mw->smask_in),"insert_text",G_CALLBACK(insert_text_handler),NULL);
   g_signal_connect(G_OBJECT(mw->adr_button),"clicked",G_CALLBACK(update_net),mw);
   /* subnetting section */
-  g_signal_connect(G_OBJECT(mw->host_in),"insert_text",G_CALLBACK(insert_text_handler),NULL);
+  g_signal_connect(G_OBJECT(mw->host_in),"insert_text",G_CALLBACK(insert_text_handler),(gpointer) HOSTS_CHARS);
   g_signal_connect(G_OBJECT(mw->host_in),"activate",G_CALLBACK(host_in_activate_handler),mw);
+  g_signal_connect(G_OBJECT(mw->host_in),"changed",G_CALLBACK(host_in_changed_handler),mw);
   g_signal_connect(G_OBJECT(mw->subnet_button),"clicked",G_CALLBACK(subnet_button_clicked_handler),mw);
   g_signal_connect(G_OBJECT(mw->reset_button),"clicked",G_CALLBACK(reset_button_clicked_handler),mw);
 }
@@ -528,6 +682,14 @@ static void aesthetics(MainWindow *mw)
 MainWindow* mw_new()
 {
   MainWindow *mw = g_malloc(sizeof(MainWindow)); // Make new MainWindow struct
+  mw->planner = NULL; // no plan until the first VLSM
+  mw->ws_mem = NULL; // no workspace until the first VLSM
+  mw->ws.cap = 0;
+  mw->changes = NULL;
+  mw->changes_cap = 0;
+  mw->job = NULL; // no solve running
+  mw->worker = NULL;
+  mw->progress_id = 0;
   mw->window = gtk_window_new(GTK_WINDOW_TOPLEVEL); // Make a pointer to a gtk
                                                     // Window.
   // Construct and place
@@ -557,5 +719,9 @@ void mw_show(MainWindow *mw)
  */
 void mw_free(MainWindow *mw)
 {
+  stop_solve(mw);
+  planner_free(mw->planner);
+  g_free(mw->ws_mem);
+  g_free(mw->changes);
   g_free(mw);
 }
@@ -23,21 +23,8 @@
 #define MAIN_WIN_H
 
 #include <gtk/gtk.h>
-
-/**
- * enum for subnet_tree
- */
-enum
-{
-  COL_NAME = 0,
-  COL_ADDR,
-  //COL_SMASK,
-  COL_DMASK,
-  COL_FHOST,
-  COL_LHOST,
-  COL_BCAST,
-  NUM_COLS
-};
+#include "planner.h"
+#include "subnet_model.h"
 
 /**
  * This is the structure with all the variables and widgets in the
@@ -74,7 +61,21 @@ typedef struct main_window
 
   GtkWidget *scroll_win, *subnet_tree; // This is the Scrolled Window and the Tree View
                                        // widget
-  GtkListStore *subnet_store; // the ListStore to hold subnet data, as model for subnet_tree
+  SubnetModel *subnet_store; // the model showing subnet data in ws, for subnet_tree
+
+  planner_t *planner; // the current plan, kept between updates so that
+                      // editing host_in does not renumber other subnets
+  ipv4u32_t plan_addr; // base network of planner
+  unsigned char plan_mask;
+
+  void *ws_mem; // memory behind ws, grown as host_in gets longer and
+  vlsm_ws_t ws; // reused by every VLSM after
+  planner_change_t *changes; // room for changes_cap changes of planner_update
+  int changes_cap;
+
+  struct solve_job *job; // the solve running in worker, NULL if none
+  GThread *worker;
+  guint progress_id; // timeout showing the progress of job
 
 } MainWindow;
 
@@ -0,0 +1,625 @@
+/*********************************************************
+ * ipam.c  --- Buddy allocator of prefixes of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "vlsm.h"
+#include "snapshot.h"
+#include "ipam.h"
+
+
+/**** buddy tree ****
+ * The address space is a binary tree of aligned blocks. A block is FREE,
+ * USED (a subnet, or space outside the base network) or SPLIT into its two
+ * halves. FREE blocks of each order (log2 of the size) are kept on a
+ * doubly linked list, and two FREE buddies are always merged, so the
+ * smallest FREE block that holds a request is the best fit.
+ */
+
+#define BT_NIL      0xffffffffU
+#define BT_FREE     0
+#define BT_USED     1
+#define BT_SPLIT    2
+
+typedef struct
+{
+  ipv4u32_t       addr;
+  unsigned char   order;
+  unsigned char   state;
+  uint32_t        parent,
+                  child,      /* left half, the right half is child+1 */
+                  prev,       /* FREE list of this order */
+                  next;       /* FREE list, or list of unused node pairs */
+} bt_node_t;
+
+typedef struct
+{
+  bt_node_t     * nodes;      /* nodes[0] is the root */
+  uint32_t        nnodes,
+                  cap,
+                  spare,      /* unused node pairs */
+                  nspare;
+  uint32_t        head[IPV4_BITLEN + 1];
+  int             in_image;   /* nodes live in a snapshot, not on the heap */
+} btree_t;
+
+/**
+ * how a btree_t starts in a snapshot, followed by its nodes
+ */
+typedef struct
+{
+  uint32_t        node_size,
+                  nnodes,
+                  spare,
+                  nspare;
+  uint32_t        head[IPV4_BITLEN + 1];
+  uint32_t        reserved;
+} bt_image_t;
+
+typedef char bt_image_size_check[sizeof(bt_image_t) == IPAM_IMAGE_WORDS * 4 ? 1 : -1];
+
+/**
+ * make sure @nsplit splits will not run out of nodes. Only grows the
+ * array when the unused pairs are not enough, so undoing a release (which
+ * left its pairs unused) never fails
+ */
+static int
+bt_reserve (btree_t   * bt,
+            int         nsplit)
+{
+  uint64_t need = (uint64_t)bt->nnodes + 2 * (uint64_t)nsplit;
+
+  if (nsplit > (int)bt->nspare && need - 2 * bt->nspare > bt->cap) {
+    uint32_t    cap = bt->cap ? bt->cap * 2 : 256;
+    bt_node_t * nodes;
+    while (cap < need) cap *= 2;
+    if (bt->in_image) {
+      /* copy on write: a snapshot cannot grow */
+      nodes = (bt_node_t *) malloc (sizeof(bt_node_t) * cap);
+      if (nodes == NULL) return 0;
+      memcpy(nodes, bt->nodes, sizeof(bt_node_t) * bt->nnodes);
+      bt->in_image = 0;
+    } else {
+      nodes = (bt_node_t *) realloc (bt->nodes, sizeof(bt_node_t) * cap);
+      if (nodes == NULL) return 0;
+    }
+    bt->nodes = nodes;
+    bt->cap = cap;
+  }
+  return 1;
+}
+
+
+static void
+bt_push (btree_t   * bt,
+         uint32_t    i)
+{
+  bt_node_t * n = &bt->nodes[i];
+  n->state = BT_FREE;
+  n->prev = BT_NIL;
+  n->next = bt->head[n->order];
+  if (n->next != BT_NIL) bt->nodes[n->next].prev = i;
+  bt->head[n->order] = i;
+}
+
+
+static void
+bt_unlink (btree_t   * bt,
+           uint32_t    i)
+{
+  bt_node_t * n = &bt->nodes[i];
+  if (n->prev != BT_NIL) bt->nodes[n->prev].next = n->next;
+  else bt->head[n->order] = n->next;
+  if (n->next != BT_NIL) bt->nodes[n->next].prev = n->prev;
+}
+
+
+/* split FREE block i into two FREE halves, needs bt_reserve() first */
+static void
+bt_split (btree_t   * bt,
+          uint32_t    i)
+{
+  uint32_t  c;
+  int       k;
+
+  if (bt->spare != BT_NIL) {
+    c = bt->spare;
+    bt->spare = bt->nodes[c].next;
+    bt->nspare--;
+  } else {
+    c = bt->nnodes;
+    bt->nnodes += 2;
+  }
+  bt_unlink(bt, i);
+  bt->nodes[i].state = BT_SPLIT;
+  bt->nodes[i].child = c;
+  for (k=0;k<2;k++) {
+    bt_node_t * n = &bt->nodes[c+k];
+    n->order = bt->nodes[i].order - 1;
+    n->addr = bt->nodes[i].addr + ((ipv4u32_t)k << n->order);
+    n->parent = i;
+    bt_push(bt, c+k);
+  }
+}
+
+
+/* child of SPLIT block i that holds addr */
+static uint32_t
+bt_child (const btree_t  * bt,
+          uint32_t         i,
+          ipv4u32_t        addr)
+{
+  const bt_node_t * n = &bt->nodes[i];
+  return n->child + ((addr >> (n->order - 1)) & 1);
+}
+
+
+/* the block of 2^order addresses at addr, BT_NIL if it is not a block */
+static uint32_t
+bt_find (const btree_t  * bt,
+         ipv4u32_t        addr,
+         int              order)
+{
+  uint32_t i = 0;
+  if (order > bt->nodes[0].order
+   || (uint64_t)(addr - bt->nodes[0].addr) >> bt->nodes[0].order)
+  {
+    return BT_NIL;
+  }
+  while (bt->nodes[i].order > order && bt->nodes[i].state == BT_SPLIT) {
+    i = bt_child(bt, i, addr);
+  }
+  return (bt->nodes[i].order == order && bt->nodes[i].addr == addr) ? i : BT_NIL;
+}
+
+
+/**
+ * take the smallest FREE block of at least 2^order addresses and carve
+ * a USED block of exactly that size out of it
+ * Return 1 if Successful, 0 if there is none, -1 out of memory
+ */
+static int
+bt_alloc (btree_t    * bt,
+          int          order,
+          ipv4u32_t  * addr)
+{
+  int       j;
+  uint32_t  i;
+
+  for (j=order; j<=IPV4_BITLEN && bt->head[j]==BT_NIL; j++)
+    ;
+  if (j > IPV4_BITLEN) return 0;
+  if (!bt_reserve(bt, j - order)) return -1;
+
+  i = bt->head[j];
+  while (bt->nodes[i].order > order) {
+    bt_split(bt, i);
+    i = bt->nodes[i].child;
+  }
+  bt_unlink(bt, i);
+  bt->nodes[i].state = BT_USED;
+  *addr = bt->nodes[i].addr;
+  return 1;
+}
+
+
+/**
+ * mark the block of 2^order addresses at addr USED, splitting the FREE
+ * block that contains it
+ * Return 1 if Successful, 0 if any part of it is not FREE, -1 out of memory
+ */
+static int
+bt_claim (btree_t    * bt,
+          ipv4u32_t    addr,
+          int          order)
+{
+  uint32_t i = 0;
+
+  if (order > bt->nodes[0].order
+   || (uint64_t)(addr - bt->nodes[0].addr) >> bt->nodes[0].order)
+  {
+    return 0;
+  }
+
+  /* check first, so a failed claim leaves no split behind */
+  while (bt->nodes[i].state == BT_SPLIT && bt->nodes[i].order > order) {
+    i = bt_child(bt, i, addr);
+  }
+  if (bt->nodes[i].state != BT_FREE) return 0;
+  if (!bt_reserve(bt, bt->nodes[i].order - order)) return -1;
+
+  while (bt->nodes[i].order > order) {
+    bt_split(bt, i);
+    i = bt_child(bt, i, addr);
+  }
+  bt_unlink(bt, i);
+  bt->nodes[i].state = BT_USED;
+  return 1;
+}
+
+
+/* free USED block i and merge it with its FREE buddies */
+static void
+bt_release (btree_t   * bt,
+            uint32_t    i)
+{
+  while (bt->nodes[i].parent != BT_NIL) {
+    uint32_t p = bt->nodes[i].parent;
+    uint32_t c = bt->nodes[p].child;
+    uint32_t buddy = (i == c) ? c + 1 : c;
+    if (bt->nodes[buddy].state != BT_FREE) break;
+    bt_unlink(bt, buddy);
+    bt->nodes[c].next = bt->spare;
+    bt->spare = c;
+    bt->nspare++;
+    i = p;
+  }
+  bt_push(bt, i);
+}
+
+
+/**
+ * a tree over [start,end): the root is the smallest aligned block that
+ * covers the range, whatever lies outside the range is marked USED
+ */
+static int
+bt_init (btree_t   * bt,
+         uint64_t    start,
+         uint64_t    end)
+{
+  int       order = 0,
+            side;
+  uint64_t  root;
+
+  memset(bt, 0, sizeof(*bt));
+  memset(bt->head, 0xff, sizeof(bt->head));
+  bt->spare = BT_NIL;
+  while ((start >> order) != ((end - 1) >> order)) order++;
+  root = (start >> order) << order;
+
+  if (!bt_reserve(bt, 1)) return 0;
+  bt->nnodes = 1;
+  bt->nodes[0].addr = (ipv4u32_t)root;
+  bt->nodes[0].order = (unsigned char)order;
+  bt->nodes[0].parent = BT_NIL;
+  bt_push(bt, 0);
+
+  /* reserve [root,start) and [end,root+2^order) */
+  for (side=0;side<2;side++) {
+    uint64_t a = side ? end : root;
+    uint64_t e = side ? root + ((uint64_t)1 << order) : start;
+    while (a < e) {
+      int o = 0;
+      while (o < IPV4_BITLEN && !((a >> o) & 1)) o++;
+      while (a + ((uint64_t)1 << o) > e) o--;
+      if (bt_claim(bt, (ipv4u32_t)a, o) < 0) return 0;
+      a += (uint64_t)1 << o;
+    }
+  }
+  return 1;
+}
+
+
+/**** ipam ****/
+
+struct ipam
+{
+  btree_t           bt;
+  unsigned char     mask;
+  uint64_t          start,      /* the base network is [start,end) */
+                    end;
+  snap_t            snap;       /* opened by ipam_load() */
+};
+
+
+/* a pool over @base without its tree. Return NULL if out of memory */
+static ipam_t *
+ipam_alloc_pool (const network_t * base)
+{
+  ipam_t * ipam = (ipam_t *) calloc (1, sizeof(ipam_t));
+  if (ipam == NULL) return NULL;
+  ipam->mask = base->mask;
+  ipam->start = ipv4tonet32(ipv4tou32(base->addr), base->mask);
+  ipam->end = ipam->start + ((uint64_t)1 << (IPV4_BITLEN - base->mask));
+  if (ipam->end > (uint64_t)1 << IPV4_BITLEN) ipam->end = (uint64_t)1 << IPV4_BITLEN;
+  return ipam;
+}
+
+
+/* RETURN the order of @subnet if it is an aligned block inside the pool, else -1 */
+static int
+ipam_order (const ipam_t     * ipam,
+            const network_t  * subnet,
+            ipv4u32_t        * addr)
+{
+  int order;
+
+  if (subnet->mask < ipam->mask || subnet->mask > IPV4_BITLEN) return -1;
+  order = IPV4_BITLEN - subnet->mask;
+  *addr = ipv4tou32(subnet->addr);
+  if (order < IPV4_BITLEN && (*addr & ~masktou32(subnet->mask)) != 0) return -1;
+  if (*addr < ipam->start || *addr + ((uint64_t)1 << order) > ipam->end) return -1;
+  return order;
+}
+
+
+ipam_t *
+ipam_new (const network_t * base)
+{
+  ipam_t * ipam;
+
+  if (base->mask > IPV4_BITLEN) return NULL;
+  ipam = ipam_alloc_pool(base);
+  if (ipam == NULL) return NULL;
+  if (!bt_init(&ipam->bt, ipam->start, ipam->end)) {
+    ipam_free(ipam);
+    return NULL;
+  }
+  return ipam;
+}
+
+
+void
+ipam_free (ipam_t * ipam)
+{
+  if (ipam == NULL) return;
+  if (!ipam->bt.in_image) free(ipam->bt.nodes);
+  snap_close(&ipam->snap);
+  free(ipam);
+}
+
+
+int
+ipam_alloc (ipam_t         * ipam,
+            unsigned char    prefix_len,
+            network_t      * subnet)
+{
+  ipv4u32_t addr;
+  int       r;
+
+  if (prefix_len < ipam->mask || prefix_len > IPV4_BITLEN) return -1;
+  r = bt_alloc(&ipam->bt, IPV4_BITLEN - prefix_len, &addr);
+  if (r <= 0) return r ? -3 : -2;
+  u32toipv4(subnet->addr, addr);
+  subnet->mask = prefix_len;
+  return 0;
+}
+
+
+int
+ipam_alloc_at (ipam_t            * ipam,
+               const network_t   * subnet)
+{
+  ipv4u32_t addr;
+  int       order = ipam_order(ipam, subnet, &addr),
+            r;
+
+  if (order < 0) return -1;
+  r = bt_claim(&ipam->bt, addr, order);
+  if (r <= 0) return r ? -3 : -2;
+  return 0;
+}
+
+
+int
+ipam_release (ipam_t            * ipam,
+              const network_t   * subnet)
+{
+  ipv4u32_t addr;
+  uint32_t  i;
+  int       order = ipam_order(ipam, subnet, &addr);
+
+  if (order < 0) return -1;
+  i = bt_find(&ipam->bt, addr, order);
+  if (i == BT_NIL || ipam->bt.nodes[i].state != BT_USED) return -1;
+  bt_release(&ipam->bt, i);
+  return 0;
+}
+
+
+int
+ipam_find_free (const ipam_t   * ipam,
+                unsigned char    prefix_len,
+                network_t      * subnet)
+{
+  int j;
+
+  if (prefix_len < ipam->mask || prefix_len > IPV4_BITLEN) return -1;
+  for (j=IPV4_BITLEN-prefix_len; j<=IPV4_BITLEN && ipam->bt.head[j]==BT_NIL; j++)
+    ;
+  if (j > IPV4_BITLEN) return -2;
+
+  /* ipam_alloc() carves the lowest part out of that block */
+  u32toipv4(subnet->addr, ipam->bt.nodes[ipam->bt.head[j]].addr);
+  subnet->mask = prefix_len;
+  return 0;
+}
+
+
+int
+ipam_image_parts (const ipam_t  * ipam,
+                  uint32_t        scratch[IPAM_IMAGE_WORDS],
+                  snap_part_t     parts[IPAM_IMAGE_PARTS])
+{
+  bt_image_t image;
+
+  memset(&image, 0, sizeof(image));
+  image.node_size = sizeof(bt_node_t);
+  image.nnodes = ipam->bt.nnodes;
+  image.spare = ipam->bt.spare;
+  image.nspare = ipam->bt.nspare;
+  memcpy(image.head, ipam->bt.head, sizeof(image.head));
+  memcpy(scratch, &image, sizeof(image));
+
+  parts[0].data = scratch;
+  parts[0].len = sizeof(image);
+  parts[1].data = ipam->bt.nodes;
+  parts[1].len = sizeof(bt_node_t) * ipam->bt.nnodes;
+  return IPAM_IMAGE_PARTS;
+}
+
+
+/**
+ * check that every index in the @nodes of the image @hdr stays inside it
+ * and that no walk down or up the tree can loop. Done whether or not the
+ * checksum was verified, a damaged file must not make us follow it out
+ * Return 1 if the nodes can be used, 0 if not
+ */
+static int
+bt_image_check (const bt_node_t   * nodes,
+                const bt_image_t  * hdr)
+{
+  uint32_t  i,
+            c;
+  int       j;
+
+  for (j=0;j<=IPV4_BITLEN;j++) {
+    c = hdr->head[j];
+    if (c != BT_NIL && (c >= hdr->nnodes || nodes[c].order != j
+                     || nodes[c].state != BT_FREE || nodes[c].prev != BT_NIL))
+    {
+      return 0;
+    }
+  }
+  for (i=0;i<hdr->nnodes;i++) {
+    const bt_node_t * n = &nodes[i];
+    if (n->state > BT_SPLIT || n->order > IPV4_BITLEN
+     || (n->parent != BT_NIL && n->parent >= hdr->nnodes)
+     || (n->prev != BT_NIL && n->prev >= hdr->nnodes)
+     || (n->next != BT_NIL && n->next >= hdr->nnodes))
+    {
+      return 0;
+    }
+  }
+
+  /*
+   * the tree, in order. Unused pairs keep stale fields, so only nodes
+   * reached from the root are checked: the children of a SPLIT node are
+   * one order lower and point back to it, so every walk ends
+   */
+  if (nodes[0].parent != BT_NIL) return 0;
+  i = 0;
+  for (;;) {
+    const bt_node_t * n = &nodes[i];
+    if (n->state == BT_SPLIT) {
+      c = n->child;
+      if (n->order == 0 || c >= hdr->nnodes - 1
+       || nodes[c].parent != i || nodes[c+1].parent != i
+       || nodes[c].order != n->order - 1 || nodes[c+1].order != n->order - 1)
+      {
+        return 0;
+      }
+      i = c;
+      continue;
+    }
+    /* up past right halves, then over to the next right half */
+    while (i != 0 && i == nodes[nodes[i].parent].child + 1) i = nodes[i].parent;
+    if (i == 0) break;
+    i++;
+  }
+
+  /* bt_split() takes a pair from here */
+  for (i=0, c=hdr->spare; c!=BT_NIL; i++, c=nodes[c].next) {
+    if (i >= hdr->nspare || c >= hdr->nnodes - 1) return 0;
+  }
+  return i == hdr->nspare;
+}
+
+
+ipam_t *
+ipam_image_open (const network_t  * base,
+                 void             * image,
+                 size_t             len,
+                 size_t           * used)
+{
+  bt_image_t    hdr;
+  ipam_t      * ipam;
+  bt_node_t   * nodes;
+  uint64_t      start,
+                end;
+  int           order = 0;
+
+  if (base->mask > IPV4_BITLEN || len < sizeof(hdr)) return NULL;
+  memcpy(&hdr, image, sizeof(hdr));
+  if (hdr.node_size != sizeof(bt_node_t) || hdr.nnodes == 0
+   || hdr.nnodes > (len - sizeof(hdr)) / sizeof(bt_node_t)
+   || (hdr.spare != BT_NIL && hdr.spare >= hdr.nnodes))
+  {
+    return NULL;
+  }
+  nodes = (bt_node_t *)((unsigned char *)image + sizeof(hdr));
+  if (!bt_image_check(nodes, &hdr)) return NULL;
+
+  /* the root must be the one ipam_new() makes for @base */
+  ipam = ipam_alloc_pool(base);
+  if (ipam == NULL) return NULL;
+  start = ipam->start;
+  end = ipam->end;
+  while ((start >> order) != ((end - 1) >> order)) order++;
+  if (nodes[0].order != order || nodes[0].addr != (ipv4u32_t)((start >> order) << order)) {
+    free(ipam);
+    return NULL;
+  }
+
+  ipam->bt.nodes = nodes;
+  ipam->bt.nnodes = hdr.nnodes;
+  ipam->bt.cap = hdr.nnodes;
+  ipam->bt.spare = hdr.spare;
+  ipam->bt.nspare = hdr.nspare;
+  memcpy(ipam->bt.head, hdr.head, sizeof(hdr.head));
+  ipam->bt.in_image = 1;
+  *used = sizeof(hdr) + SNAP_ALIGN(sizeof(bt_node_t) * hdr.nnodes);
+  return ipam;
+}
+
+
+int
+ipam_save (const ipam_t  * ipam,
+           FILE          * out)
+{
+  uint32_t      scratch[IPAM_IMAGE_WORDS];
+  snap_part_t   parts[IPAM_IMAGE_PARTS];
+  network_t     base;
+  ipv4_t        addr;
+
+  u32toipv4(addr, (ipv4u32_t)ipam->start);
+  makenetwork(&base, addr, ipam->mask);
+  return snap_write(out, SNAP_IPAM, 0, &base, parts, ipam_image_parts(ipam, scratch, parts));
+}
+
+
+int
+ipam_load (ipam_t       ** ipam,
+           const char    * path,
+           int             verify)
+{
+  snap_t  snap;
+  size_t  used;
+  int     r;
+
+  *ipam = NULL;
+  r = snap_open(&snap, path, SNAP_IPAM, verify);
+  if (r < 0) return r;
+  *ipam = ipam_image_open(&snap.base, snap.payload, snap.payloadlen, &used);
+  if (*ipam == NULL) {
+    snap_close(&snap);
+    return -2;
+  }
+  (*ipam)->snap = snap;
+  return 0;
+}
@@ -0,0 +1,148 @@
+/*********************************************************
+ * ipam.h  --- Buddy allocator of prefixes of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef IPAM_H
+#define IPAM_H
+
+#include <stdio.h>
+#include "vlsm.h"
+#include "snapshot.h"
+
+/**
+ * a base network kept as a live pool of prefixes. Prefixes are handed out
+ * and taken back one at a time, always on their natural boundary, and free
+ * buddies are merged again. Every operation costs O(32) steps, independent
+ * of how many prefixes are allocated
+ */
+typedef struct ipam ipam_t;
+
+
+/**
+ * create a pool over the base network @base (host bits of its address
+ * cleared), the same address space vlsm() uses. The whole pool is free
+ * Return NULL if the mask of @base is invalid or out of memory
+ */
+ipam_t              * ipam_new            (const network_t        * base);
+
+
+void                  ipam_free           (ipam_t                 * ipam);
+
+
+/**
+ * allocate a prefix of length @prefix_len out of the smallest free block
+ * that holds it, so large blocks stay whole. Stored to @subnet
+ * Return:
+ *    0  : Successful
+ *   -1  : @prefix_len is shorter than the base mask or longer than 32
+ *   -2  : no free block that large
+ *   -3  : out of memory
+ */
+int                   ipam_alloc          (ipam_t                 * ipam,
+                                           unsigned char            prefix_len,
+                                           network_t              * subnet);
+
+
+/**
+ * allocate exactly @subnet
+ * Return:
+ *    0  : Successful
+ *   -1  : @subnet is not aligned or not inside the base network
+ *   -2  : some of @subnet is in use
+ *   -3  : out of memory
+ */
+int                   ipam_alloc_at       (ipam_t                 * ipam,
+                                           const network_t        * subnet);
+
+
+/**
+ * give back @subnet, which must be a prefix returned by ipam_alloc() or
+ * ipam_alloc_at()
+ * Return: 0 if Successful, -1 if @subnet is not an allocated prefix
+ */
+int                   ipam_release        (ipam_t                 * ipam,
+                                           const network_t        * subnet);
+
+
+/**
+ * find the block ipam_alloc() would take for @prefix_len without
+ * allocating it. Stored to @subnet
+ * Return: 0 if found, -1 bad @prefix_len, -2 no free block that large
+ */
+int                   ipam_find_free      (const ipam_t           * ipam,
+                                           unsigned char            prefix_len,
+                                           network_t              * subnet);
+
+
+
+/**
+ * write @ipam to @out as a snapshot, see snapshot.h
+ * Return: 0 if Successful, -1 write error
+ */
+int                   ipam_save           (const ipam_t           * ipam,
+                                           FILE                   * out);
+
+
+/**
+ * open the snapshot @path written by ipam_save() as *@ipam. The pool is
+ * used straight from the mapped file, nothing is copied or parsed; its
+ * node links are bounds-checked in one pass over them either way. It can
+ * be changed right away, see snap_open() for how. The checksum is only
+ * checked if @verify
+ * Return:
+ *    0 : Successful
+ *   -1 : cannot open/read @path
+ *   -2 : not an ipam snapshot, or damaged
+ */
+int                   ipam_load           (ipam_t                ** ipam,
+                                           const char             * path,
+                                           int                      verify);
+
+
+/**
+ * for snapshots that hold an ipam_t among other things, such as planner_t:
+ * store the parts that make up @ipam to @parts, the first one lives in
+ * @scratch. RETURN the number of parts
+ */
+#define IPAM_IMAGE_PARTS  2
+#define IPAM_IMAGE_WORDS  38
+
+int                   ipam_image_parts    (const ipam_t           * ipam,
+                                           uint32_t                 scratch[IPAM_IMAGE_WORDS],
+                                           snap_part_t              parts[IPAM_IMAGE_PARTS]);
+
+
+/**
+ * make a pool over @base that works on the @len bytes of snapshot payload
+ * at @image in place; the caller keeps the snapshot open as long as the
+ * pool lives. *@used receives how many bytes of @image it took
+ * RETURN NULL if the image does not match @base, is damaged, or out of memory
+ */
+ipam_t              * ipam_image_open     (const network_t        * base,
+                                           void                   * image,
+                                           size_t                   len,
+                                           size_t                 * used);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,740 @@
+/*********************************************************
+ * journal.c  --- Journaled prefix pool of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#else
+#include <io.h>
+#endif
+#include "vlsm.h"
+#include "snapshot.h"
+#include "ipam.h"
+#include "journal.h"
+
+#define REPLAY_RECS   4096    /* records read at a time by replay */
+
+
+struct journal
+{
+  pthread_mutex_t     lock;
+  pthread_cond_t      cond;         /* a sync finished */
+  ipam_t            * ipam;
+  snap_t              snap;         /* the snapshot ipam started from */
+  network_t           base;
+  char              * path;
+  size_t              pathlen;
+  uint32_t            first_gen,    /* oldest log on disk */
+                      gen;          /* log being appended */
+  FILE              * log;
+  uint64_t            logrecs;      /* records in log */
+
+  /* group commit */
+  unsigned char     * pend;         /* records not written yet */
+  size_t              npend,
+                      cappend;
+  unsigned char     * wbuf;         /* records being written by the leader */
+  size_t              capw;
+  uint64_t            lsn,          /* records made */
+                      synced;       /* records on disk */
+  int                 syncing,
+                      failed;
+
+  /* compaction */
+  pthread_t           compactor;
+  int                 compacting,
+                      joinable;
+};
+
+/**
+ * what a compaction thread writes: a copy of the tree taken at the
+ * moment log @gen was started
+ */
+typedef struct
+{
+  journal_t         * journal;
+  uint32_t            first_gen,
+                      gen;
+  uint32_t            scratch[IPAM_IMAGE_WORDS];
+  snap_part_t         parts[IPAM_IMAGE_PARTS];
+  void              * nodes;
+} compact_job_t;
+
+
+/* little endian helpers */
+static void
+put_le32 (unsigned char * p,
+          uint32_t        v)
+{
+  p[0] = (unsigned char) v;
+  p[1] = (unsigned char)(v >> 8);
+  p[2] = (unsigned char)(v >> 16);
+  p[3] = (unsigned char)(v >> 24);
+}
+
+static uint32_t
+get_le32 (const unsigned char * p)
+{
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8
+       | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+static uint32_t
+fnv1a (const unsigned char  * p,
+       size_t                 len)
+{
+  uint32_t h = 2166136261U;
+  while (len--) {
+    h ^= *p++;
+    h *= 16777619U;
+  }
+  return h;
+}
+
+
+static int
+same_network (const network_t * a,
+              const network_t * b)
+{
+  return a->mask == b->mask
+      && ipv4tonet32(ipv4tou32(a->addr), a->mask) == ipv4tonet32(ipv4tou32(b->addr), b->mask);
+}
+
+
+/* names of the files of the pool, @buf holds pathlen + 32 bytes */
+static char *
+log_name (const journal_t  * journal,
+          char             * buf,
+          uint32_t           gen)
+{
+  sprintf(buf, "%s.%lu.log", journal->path, (unsigned long)gen);
+  return buf;
+}
+
+static char *
+snap_name (const journal_t  * journal,
+           char             * buf,
+           int                tmp)
+{
+  sprintf(buf, "%s.snap%s", journal->path, tmp ? ".tmp" : "");
+  return buf;
+}
+
+
+static int
+file_exists (const char * name)
+{
+  FILE * f = fopen(name, "rb");
+  if (f == NULL) return 0;
+  fclose(f);
+  return 1;
+}
+
+
+static int
+file_sync (FILE * f)
+{
+  if (fflush(f) != 0) return -1;
+#ifndef _WIN32
+  return fsync(fileno(f));
+#else
+  return _commit(_fileno(f));
+#endif
+}
+
+
+/* make a new or renamed file in the directory of @name durable */
+static int
+dir_sync (const char * name)
+{
+#ifndef _WIN32
+  const char  * slash = strrchr(name, '/');
+  char        * dir;
+  size_t        len;
+  int           fd,
+                r;
+
+  if (slash == NULL) {
+    name = ".";
+    len = 1;
+  } else {
+    len = (slash == name) ? 1 : (size_t)(slash - name);
+  }
+  dir = (char *) malloc (len + 1);
+  if (dir == NULL) return -1;
+  memcpy(dir, name, len);
+  dir[len] = '\0';
+  fd = open(dir, O_RDONLY);
+  free(dir);
+  if (fd < 0) return -1;
+  r = fsync(fd);
+  close(fd);
+  return r;
+#else
+  (void)name;
+  return 0;
+#endif
+}
+
+
+/* the base network in the header of log @name. Return 0 if it was read */
+static int
+log_base (const char  * name,
+          network_t   * base)
+{
+  unsigned char   header[JOURNAL_HEADERLEN];
+  FILE          * f = fopen(name, "rb");
+  int             r = -1;
+
+  if (f == NULL) return -1;
+  if (fread(header, 1, sizeof(header), f) == sizeof(header)
+   && memcmp(header, JOURNAL_MAGIC, 4) == 0 && header[5] <= IPV4_BITLEN)
+  {
+    makenetwork(base, header + 8, header[5]);
+    r = 0;
+  }
+  fclose(f);
+  return r;
+}
+
+
+/* create the empty log @gen, on disk when it returns. NULL on error */
+static FILE *
+log_create (journal_t  * journal,
+            uint32_t     gen)
+{
+  unsigned char   header[JOURNAL_HEADERLEN];
+  char          * name = (char *) malloc (journal->pathlen + 32);
+  FILE          * f;
+
+  if (name == NULL) return NULL;
+  f = fopen(log_name(journal, name, gen), "wb");
+  memset(header, 0, sizeof(header));
+  memcpy(header, JOURNAL_MAGIC, 4);
+  header[4] = JOURNAL_VERSION;
+  header[5] = journal->base.mask;
+  ipv4cpy(header + 8, journal->base.addr);
+  put_le32(header + 12, gen);
+  if (f != NULL
+   && (fwrite(header, 1, sizeof(header), f) != sizeof(header)
+    || file_sync(f) != 0 || dir_sync(name) != 0))
+  {
+    fclose(f);
+    remove(name);
+    f = NULL;
+  }
+  free(name);
+  return f;
+}
+
+
+/**
+ * apply the log @gen to the pool. The newest log (@last) may end in a
+ * torn record, which is cut off; it is then kept open for appending
+ * Return 0, -1 cannot read, -2 damaged, -3 out of memory
+ */
+static int
+log_replay (journal_t  * journal,
+            uint32_t     gen,
+            int          last)
+{
+  unsigned char   header[JOURNAL_HEADERLEN];
+  unsigned char * recs;
+  char          * name = (char *) malloc (journal->pathlen + 32);
+  FILE          * f;
+  long            good = JOURNAL_HEADERLEN;
+  size_t          n = 0,
+                  i;
+  int             r = 0,
+                  torn = 0;
+
+  journal->logrecs = 0;
+  recs = (unsigned char *) malloc (JOURNAL_RECLEN * REPLAY_RECS);
+  if (name == NULL || recs == NULL) {
+    free(name);
+    free(recs);
+    return -3;
+  }
+  f = fopen(log_name(journal, name, gen), last ? "r+b" : "rb");
+  if (f == NULL) {
+    r = -1;
+  } else if (last && fread(header, 1, sizeof(header), f) != sizeof(header)) {
+    /* crashed while creating it, nothing was logged yet */
+    fclose(f);
+    f = NULL;
+    journal->log = log_create(journal, gen);
+    if (journal->log == NULL) r = -1;
+    free(name);
+    free(recs);
+    return r;
+  } else if ((!last && fread(header, 1, sizeof(header), f) != sizeof(header))
+          || memcmp(header, JOURNAL_MAGIC, 4) != 0 || header[4] != JOURNAL_VERSION
+          || header[5] != journal->base.mask
+          || ipv4tou32(header + 8) != ipv4tou32(journal->base.addr)
+          || get_le32(header + 12) != gen)
+  {
+    r = -2;
+  }
+
+  while (r == 0 && !torn && (n = fread(recs, 1, JOURNAL_RECLEN * REPLAY_RECS, f)) > 0) {
+    for (i=0; i + JOURNAL_RECLEN <= n; i += JOURNAL_RECLEN) {
+      unsigned char * rec = recs + i;
+      network_t       subnet;
+
+      if (get_le32(rec + 12) != fnv1a(rec, 12) || rec[1] > IPV4_BITLEN) {
+        torn = 1;
+        break;
+      }
+      u32toipv4(subnet.addr, get_le32(rec + 4));
+      subnet.mask = rec[1];
+      if (rec[0] == JOURNAL_ALLOC) {
+        r = ipam_alloc_at(journal->ipam, &subnet);
+      } else if (rec[0] == JOURNAL_FREE) {
+        r = ipam_release(journal->ipam, &subnet);
+      } else {
+        r = -2;
+      }
+      if (r < 0) {
+        if (r != -3) r = -2;    /* does not fit the pool: not our log */
+        break;
+      }
+      good += JOURNAL_RECLEN;
+      journal->logrecs++;
+    }
+    if (i < n) torn = 1;        /* includes a partial record at the end */
+  }
+  if (r == 0 && f != NULL && ferror(f)) r = -1;
+
+  /* a torn record can only be the last thing written before a crash */
+  if (r == 0 && torn && !last) r = -2;
+  if (r == 0 && last) {
+    if (torn) {
+      fflush(f);
+#ifndef _WIN32
+      if (ftruncate(fileno(f), good) != 0) r = -1;
+#else
+      if (_chsize(_fileno(f), good) != 0) r = -1;
+#endif
+    }
+    if (r == 0 && fseek(f, good, SEEK_SET) != 0) r = -1;
+  }
+
+  if (r == 0 && last) {
+    journal->log = f;
+  } else if (f != NULL) {
+    fclose(f);
+  }
+  free(name);
+  free(recs);
+  return r;
+}
+
+
+/**
+ * wait until record @upto is on disk. The first thread to find nothing
+ * being written becomes the leader and writes and syncs every pending
+ * record; the others wait for it. Called and returns with the lock held
+ */
+static int
+commit_locked (journal_t  * journal,
+               uint64_t     upto)
+{
+  while (journal->synced < upto && !journal->failed) {
+    unsigned char * buf;
+    size_t          len,
+                    cap;
+    uint64_t        target;
+    FILE          * log;
+    int             ok;
+
+    if (journal->syncing) {
+      pthread_cond_wait(&journal->cond, &journal->lock);
+      continue;
+    }
+
+    /* leader: take the pending records, appends go to the other buffer */
+    buf = journal->pend;
+    cap = journal->cappend;
+    len = journal->npend;
+    journal->pend = journal->wbuf;
+    journal->cappend = journal->capw;
+    journal->npend = 0;
+    journal->wbuf = buf;
+    journal->capw = cap;
+    target = journal->lsn;
+    log = journal->log;
+    journal->syncing = 1;
+
+    pthread_mutex_unlock(&journal->lock);
+    ok = fwrite(buf, 1, len, log) == len && file_sync(log) == 0;
+    pthread_mutex_lock(&journal->lock);
+
+    journal->syncing = 0;
+    if (ok) journal->synced = target;
+    else journal->failed = 1;
+    pthread_cond_broadcast(&journal->cond);
+  }
+  return (journal->synced >= upto) ? 0 : -4;
+}
+
+
+/* room for one more pending record */
+static int
+pend_reserve (journal_t * journal)
+{
+  if (journal->npend + JOURNAL_RECLEN > journal->cappend) {
+    size_t          cap = journal->cappend ? journal->cappend * 2 : JOURNAL_RECLEN * 1024;
+    unsigned char * pend = (unsigned char *) realloc (journal->pend, cap);
+    if (pend == NULL) return 0;
+    journal->pend = pend;
+    journal->cappend = cap;
+  }
+  return 1;
+}
+
+
+/* add a record, needs pend_reserve() first */
+static void
+pend_add (journal_t        * journal,
+          int                op,
+          const network_t  * subnet,
+          uint32_t           tag)
+{
+  unsigned char * rec = journal->pend + journal->npend;
+
+  rec[0] = (unsigned char)op;
+  rec[1] = subnet->mask;
+  rec[2] = rec[3] = 0;
+  put_le32(rec + 4, ipv4tou32(subnet->addr));
+  put_le32(rec + 8, tag);
+  put_le32(rec + 12, fnv1a(rec, 12));
+  journal->npend += JOURNAL_RECLEN;
+  journal->lsn++;
+  journal->logrecs++;
+}
+
+
+/* write the copy of the tree to a new snapshot, then drop the logs it covers */
+static int
+compact_write (compact_job_t * job)
+{
+  journal_t * journal = job->journal;
+  char      * tmp = (char *) malloc (journal->pathlen + 32),
+            * name = (char *) malloc (journal->pathlen + 32);
+  FILE      * f = NULL;
+  uint32_t    g;
+  int         ok = 0;
+
+  if (tmp != NULL && name != NULL) {
+    f = fopen(snap_name(journal, tmp, 1), "wb");
+  }
+  if (f != NULL) {
+    ok = snap_write(f, SNAP_IPAM, job->gen, &journal->base, job->parts, IPAM_IMAGE_PARTS) == 0
+      && file_sync(f) == 0;
+    ok = (fclose(f) == 0) && ok;
+  }
+  if (ok) {
+    snap_name(journal, name, 0);
+#ifdef _WIN32
+    remove(name);
+#endif
+    ok = rename(tmp, name) == 0 && dir_sync(name) == 0;
+  }
+  if (ok) {
+    for (g=job->first_gen; g<job->gen; g++) remove(log_name(journal, name, g));
+  } else if (tmp != NULL) {
+    remove(tmp);
+  }
+  free(tmp);
+  free(name);
+  free(job->nodes);
+  return ok;
+}
+
+
+static void *
+compact_main (void * arg)
+{
+  compact_job_t * job = (compact_job_t *) arg;
+  journal_t     * journal = job->journal;
+  int             ok = compact_write(job);
+
+  pthread_mutex_lock(&journal->lock);
+  if (ok) journal->first_gen = job->gen;
+  journal->compacting = 0;
+  pthread_mutex_unlock(&journal->lock);
+  free(job);
+  return NULL;
+}
+
+
+/* see journal_compact(), called with the lock held */
+static int
+compact_locked (journal_t * journal)
+{
+  compact_job_t * job;
+  FILE          * log;
+
+  if (journal->compacting) return 1;
+  if (journal->joinable) {
+    pthread_join(journal->compactor, NULL);
+    journal->joinable = 0;
+  }
+
+  /* the old log must be complete before changes go to the new one */
+  while (journal->synced < journal->lsn && !journal->failed) {
+    commit_locked(journal, journal->lsn);
+  }
+  if (journal->failed) return -4;
+
+  job = (compact_job_t *) calloc (1, sizeof(compact_job_t));
+  if (job == NULL) return -3;
+  ipam_image_parts(journal->ipam, job->scratch, job->parts);
+  job->nodes = malloc(job->parts[1].len);
+  if (job->nodes == NULL) {
+    free(job);
+    return -3;
+  }
+  memcpy(job->nodes, job->parts[1].data, job->parts[1].len);
+  job->parts[1].data = job->nodes;
+
+  log = log_create(journal, journal->gen + 1);
+  if (log == NULL) {
+    free(job->nodes);
+    free(job);
+    return -1;
+  }
+  fclose(journal->log);
+  journal->log = log;
+  journal->gen++;
+  journal->logrecs = 0;
+
+  job->journal = journal;
+  job->first_gen = journal->first_gen;
+  job->gen = journal->gen;
+  journal->compacting = 1;
+  if (pthread_create(&journal->compactor, NULL, compact_main, job) == 0) {
+    journal->joinable = 1;
+  } else {
+    /* no thread, do it here */
+    if (compact_write(job)) journal->first_gen = job->gen;
+    journal->compacting = 0;
+    free(job);
+  }
+  return 0;
+}
+
+
+/* a change of the pool and its record, see journal_alloc() */
+static int
+journal_change (journal_t        * journal,
+                int                op,
+                int                at,
+                unsigned char      prefix_len,
+                network_t        * subnet,
+                uint32_t           tag)
+{
+  int r;
+
+  pthread_mutex_lock(&journal->lock);
+  if (journal->failed) {
+    r = -4;
+  } else if (!pend_reserve(journal)) {
+    r = -3;
+  } else {
+    if (op == JOURNAL_FREE) r = ipam_release(journal->ipam, subnet);
+    else if (at) r = ipam_alloc_at(journal->ipam, subnet);
+    else r = ipam_alloc(journal->ipam, prefix_len, subnet);
+    if (r == 0) {
+      pend_add(journal, op, subnet, tag);
+      r = commit_locked(journal, journal->lsn);
+      if (r == 0 && journal->logrecs >= JOURNAL_COMPACT_RECS) {
+        compact_locked(journal);   /* it is retried by the next change if it fails */
+      }
+    }
+  }
+  pthread_mutex_unlock(&journal->lock);
+  return r;
+}
+
+
+int
+journal_open (journal_t        ** journal,
+              const char        * path,
+              const network_t   * base)
+{
+  journal_t * j;
+  network_t   logbase;
+  char      * name;
+  uint32_t    gen = 0,
+              last,
+              g;
+  int         r = 0;
+
+  *journal = NULL;
+  j = (journal_t *) calloc (1, sizeof(journal_t));
+  if (j == NULL) return -3;
+  j->pathlen = strlen(path);
+  j->path = (char *) malloc (j->pathlen + 1);
+  name = (char *) malloc (j->pathlen + 32);
+  if (j->path == NULL || name == NULL) {
+    free(j->path);
+    free(name);
+    free(j);
+    return -3;
+  }
+  memcpy(j->path, path, j->pathlen + 1);
+  pthread_mutex_init(&j->lock, NULL);
+  pthread_cond_init(&j->cond, NULL);
+
+  /* the snapshot, or a new pool */
+  if (file_exists(snap_name(j, name, 0))) {
+    size_t used;
+    r = snap_open(&j->snap, name, SNAP_IPAM, 1);
+    if (r == 0 && base != NULL && !same_network(base, &j->snap.base)) r = -2;
+    if (r == 0) {
+      j->base = j->snap.base;
+      gen = (uint32_t)j->snap.stamp;
+      j->ipam = ipam_image_open(&j->base, j->snap.payload, j->snap.payloadlen, &used);
+      if (j->ipam == NULL) r = -2;
+    }
+  } else if (base == NULL && log_base(log_name(j, name, 0), &logbase) == 0) {
+    /* logs but no snapshot yet */
+    j->base = logbase;
+    j->ipam = ipam_new(&logbase);
+    if (j->ipam == NULL) r = -3;
+  } else if (base == NULL) {
+    r = -1;
+  } else if (base->mask > IPV4_BITLEN) {
+    r = -2;
+  } else {
+    makenetwork(&j->base, base->addr, base->mask);
+    ipv4tonet(j->base.addr, base->addr, base->mask);
+    j->ipam = ipam_new(&j->base);
+    if (j->ipam == NULL) r = -3;
+  }
+
+  if (r == 0) {
+    /* older logs are in the snapshot, a compaction did not get to them */
+    for (g=gen; g>0 && remove(log_name(j, name, g - 1)) == 0; g--)
+      ;
+    for (last=gen; file_exists(log_name(j, name, last)); last++)
+      ;
+    j->first_gen = gen;
+    if (last == gen) {
+      j->gen = gen;
+      j->log = log_create(j, gen);
+      if (j->log == NULL) r = -1;
+    } else {
+      j->gen = last - 1;
+      for (g=gen; r==0 && g<last; g++) {
+        r = log_replay(j, g, g == last - 1);
+      }
+    }
+  }
+
+  free(name);
+  if (r < 0) {
+    journal_close(j);
+    return r;
+  }
+  *journal = j;
+  return 0;
+}
+
+
+void
+journal_close (journal_t * journal)
+{
+  if (journal == NULL) return;
+  pthread_mutex_lock(&journal->lock);
+  if (journal->log != NULL) commit_locked(journal, journal->lsn);
+  pthread_mutex_unlock(&journal->lock);
+  if (journal->joinable) pthread_join(journal->compactor, NULL);
+
+  if (journal->log != NULL) fclose(journal->log);
+  ipam_free(journal->ipam);
+  snap_close(&journal->snap);
+  free(journal->pend);
+  free(journal->wbuf);
+  free(journal->path);
+  pthread_mutex_destroy(&journal->lock);
+  pthread_cond_destroy(&journal->cond);
+  free(journal);
+}
+
+
+int
+journal_alloc (journal_t      * journal,
+               unsigned char    prefix_len,
+               uint32_t         tag,
+               network_t      * subnet)
+{
+  return journal_change(journal, JOURNAL_ALLOC, 0, prefix_len, subnet, tag);
+}
+
+
+int
+journal_alloc_at (journal_t        * journal,
+                  const network_t  * subnet,
+                  uint32_t           tag)
+{
+  network_t s = *subnet;
+  return journal_change(journal, JOURNAL_ALLOC, 1, 0, &s, tag);
+}
+
+
+int
+journal_release (journal_t        * journal,
+                 const network_t  * subnet,
+                 uint32_t           tag)
+{
+  network_t s = *subnet;
+  return journal_change(journal, JOURNAL_FREE, 1, 0, &s, tag);
+}
+
+
+int
+journal_find_free (journal_t      * journal,
+                   unsigned char    prefix_len,
+                   network_t      * subnet)
+{
+  int r;
+  pthread_mutex_lock(&journal->lock);
+  r = ipam_find_free(journal->ipam, prefix_len, subnet);
+  pthread_mutex_unlock(&journal->lock);
+  return r;
+}
+
+
+int
+journal_compact (journal_t * journal)
+{
+  int r;
+  pthread_mutex_lock(&journal->lock);
+  r = compact_locked(journal);
+  pthread_mutex_unlock(&journal->lock);
+  return r;
+}
@@ -0,0 +1,139 @@
+/*********************************************************
+ * journal.h  --- Journaled prefix pool of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include "vlsm.h"
+
+/**
+ * An ipam_t that survives restarts. The pool stored as @path is the
+ * snapshot "@path.snap" (see snapshot.h) plus the logs "@path.<gen>.log"
+ * of every change made after it, gen counting up from the stamp of the
+ * snapshot (0 without one). Opening maps the snapshot and replays the
+ * logs; compaction starts a new log and writes a new snapshot in the
+ * background, then deletes the logs it covers.
+ *
+ * Log layout, all integers little endian:
+ *
+ *   offset  size  header
+ *        0     4  magic "VLSJ"
+ *        4     1  version (JOURNAL_VERSION)
+ *        5     1  base network mask
+ *        6     2  reserved, 0
+ *        8     4  base network address, a.b.c.d as bytes a,b,c,d
+ *       12     4  generation
+ *
+ *   then one 16 byte record per change:
+ *        0     1  JOURNAL_ALLOC or JOURNAL_FREE
+ *        1     1  mask
+ *        2     2  reserved, 0
+ *        4     4  address as uint32_t
+ *        8     4  tag, given by the caller and not used by the pool
+ *       12     4  FNV-1a hash of bytes 0-11
+ *   A torn record at the end of the newest log is cut off on open.
+ */
+#define JOURNAL_MAGIC           "VLSJ"
+#define JOURNAL_VERSION         1
+#define JOURNAL_HEADERLEN       16
+#define JOURNAL_RECLEN          16
+#define JOURNAL_ALLOC           1
+#define JOURNAL_FREE            2
+
+/* a log of this many records is compacted by the next change */
+#define JOURNAL_COMPACT_RECS    (1 << 20)
+
+typedef struct journal journal_t;
+
+
+/**
+ * open the pool stored as @path, or create it over @base if there is none.
+ * @base may be NULL for a pool that must exist; if given for an existing
+ * pool it has to match
+ * Return:
+ *    0 : Successful
+ *   -1 : cannot open/read/create the files, or no pool and no @base
+ *   -2 : damaged files, or not a pool over @base
+ *   -3 : out of memory
+ */
+int                   journal_open        (journal_t             ** journal,
+                                           const char             * path,
+                                           const network_t        * base);
+
+
+/**
+ * wait for a running compaction, then release everything. All changes
+ * are durable already
+ */
+void                  journal_close       (journal_t              * journal);
+
+
+/**
+ * ipam_alloc(), ipam_alloc_at() and ipam_release() that are on disk when
+ * they return. Safe to call from many threads: changes made while one
+ * thread waits for fsync() are written by a single fsync() after it, so
+ * the cost of a sync is shared by everybody waiting for it
+ * Return: as the ipam_* functions, or
+ *   -4  : the log could not be written. The change is made in memory but
+ *         may be lost; every later change fails too
+ */
+int                   journal_alloc       (journal_t              * journal,
+                                           unsigned char            prefix_len,
+                                           uint32_t                 tag,
+                                           network_t              * subnet);
+
+int                   journal_alloc_at    (journal_t              * journal,
+                                           const network_t        * subnet,
+                                           uint32_t                 tag);
+
+int                   journal_release     (journal_t              * journal,
+                                           const network_t        * subnet,
+                                           uint32_t                 tag);
+
+
+/**
+ * ipam_find_free() on the pool
+ */
+int                   journal_find_free   (journal_t              * journal,
+                                           unsigned char            prefix_len,
+                                           network_t              * subnet);
+
+
+/**
+ * start a compaction now: changes go to a new log from here on, and a
+ * thread writes the pool as it is to a new snapshot. Only the copy of the
+ * tree blocks the other threads
+ * Return:
+ *    0 : started
+ *    1 : one is running already
+ *   -1 : cannot create the new log
+ *   -3 : out of memory
+ *   -4 : the log could not be written
+ */
+int                   journal_compact     (journal_t              * journal);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
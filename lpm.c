@@ -0,0 +1,197 @@
+/*********************************************************
+ * lpm.c  --- Longest prefix match index of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "vlsm.h"
+#include "lpm.h"
+
+/**
+ * An entry is 0 for no prefix, index + 1 of a prefix, or LPM_CHUNK | c
+ * for chunk c, the 256 entries from chunks[c * 256] on
+ */
+#define LPM_CHUNK       0x80000000U
+#define LPM_CHUNKLEN    256
+#define LPM_AHEAD       16      /* lookups between a prefetch and its use */
+
+#ifdef __GNUC__
+#define LPM_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define LPM_PREFETCH(p) ((void)0)
+#endif
+
+struct lpm
+{
+  uint32_t            l1[1 << 16];
+  uint32_t          * chunks;
+  size_t              nchunks,
+                      cap;
+};
+
+
+/**
+ * turn @*entry into a chunk of copies of it, if it is not one already.
+ * RETURN the first entry of the chunk, NULL if out of memory
+ */
+static uint32_t *
+lpm_expand (lpm_t     * lpm,
+            uint32_t  * entries,
+            size_t      i)
+{
+  uint32_t  * chunk;
+  uint32_t    leaf = entries[i];
+  int         k;
+
+  if (leaf & LPM_CHUNK) return lpm->chunks + (size_t)(leaf & ~LPM_CHUNK) * LPM_CHUNKLEN;
+  if (lpm->nchunks == lpm->cap) {
+    size_t      cap = lpm->cap ? lpm->cap * 2 : 64;
+    uint32_t  * p = (uint32_t *) realloc (lpm->chunks, sizeof(uint32_t) * LPM_CHUNKLEN * cap);
+    if (p == NULL) return NULL;
+    /* @entries may be a chunk itself */
+    if (entries != lpm->l1) entries = p + (entries - lpm->chunks);
+    lpm->chunks = p;
+    lpm->cap = cap;
+  }
+  chunk = lpm->chunks + lpm->nchunks * LPM_CHUNKLEN;
+  for (k=0;k<LPM_CHUNKLEN;k++) chunk[k] = leaf;
+  entries[i] = LPM_CHUNK | (uint32_t)lpm->nchunks++;
+  return chunk;
+}
+
+
+/**
+ * let @addr/@mask map to @value. Prefixes come shortest first, so the
+ * entries painted over are never chunks. RETURN 0 if out of memory
+ */
+static int
+lpm_paint (lpm_t          * lpm,
+           ipv4u32_t        addr,
+           unsigned char    mask,
+           uint32_t         value)
+{
+  uint32_t  * entries = lpm->l1;
+  size_t      first,
+              count,
+              k;
+
+  if (mask <= 16) {
+    first = addr >> 16;
+    count = (size_t)1 << (16 - mask);
+  } else {
+    entries = lpm_expand(lpm, entries, addr >> 16);
+    if (entries == NULL) return 0;
+    if (mask <= 24) {
+      first = (addr >> 8) & 0xff;
+      count = (size_t)1 << (24 - mask);
+    } else {
+      entries = lpm_expand(lpm, entries, (addr >> 8) & 0xff);
+      if (entries == NULL) return 0;
+      first = addr & 0xff;
+      count = (size_t)1 << (32 - mask);
+    }
+  }
+  for (k=0;k<count;k++) entries[first + k] = value;
+  return 1;
+}
+
+
+lpm_t *
+lpm_new (const network_t  * subnets,
+         int                n)
+{
+  lpm_t * lpm;
+  int   * order;
+  int     start[IPV4_BITLEN + 2];
+  int     i,
+          m;
+
+  if (n < 0 || n > LPM_MAXN) return NULL;
+  lpm = (lpm_t *) calloc (1, sizeof(lpm_t));
+  order = (int *) malloc (sizeof(int) * ((size_t)n + 1));
+  if (lpm == NULL || order == NULL) {
+    free(order);
+    free(lpm);
+    return NULL;
+  }
+
+  /* counting sort by mask, shortest first */
+  memset(start, 0, sizeof(start));
+  for (i=0;i<n;i++) {
+    if (subnets[i].mask <= IPV4_BITLEN) start[subnets[i].mask + 1]++;
+  }
+  for (m=1;m<=IPV4_BITLEN+1;m++) start[m] += start[m-1];
+  for (i=0;i<n;i++) {
+    if (subnets[i].mask <= IPV4_BITLEN) order[start[subnets[i].mask]++] = i;
+  }
+
+  /* start[m] is the end of mask m now; the first of equal prefixes is painted last */
+  for (m=1;m<=IPV4_BITLEN;m++) {
+    for (i=start[m]-1; i>=start[m-1]; i--) {
+      const network_t * s = &subnets[order[i]];
+      if (!lpm_paint(lpm, ipv4tou32(s->addr) & prefix_table[m].mask,
+                     (unsigned char)m, (uint32_t)order[i] + 1))
+      {
+        free(order);
+        lpm_free(lpm);
+        return NULL;
+      }
+    }
+  }
+  free(order);
+  return lpm;
+}
+
+
+void
+lpm_free (lpm_t * lpm)
+{
+  if (lpm == NULL) return;
+  free(lpm->chunks);
+  free(lpm);
+}
+
+
+int
+lpm_lookup (const lpm_t  * lpm,
+            ipv4u32_t      addr)
+{
+  uint32_t e = lpm->l1[addr >> 16];
+
+  if (e & LPM_CHUNK) {
+    e = lpm->chunks[(size_t)(e & ~LPM_CHUNK) * LPM_CHUNKLEN + ((addr >> 8) & 0xff)];
+    if (e & LPM_CHUNK) {
+      e = lpm->chunks[(size_t)(e & ~LPM_CHUNK) * LPM_CHUNKLEN + (addr & 0xff)];
+    }
+  }
+  return (int)e - 1;
+}
+
+
+void
+lpm_lookup_batch (const lpm_t      * lpm,
+                  const ipv4u32_t  * addrs,
+                  int              * idx,
+                  size_t             n)
+{
+  size_t i;
+
+  for (i=0;i<n;i++) {
+    if (i + LPM_AHEAD < n) LPM_PREFETCH(&lpm->l1[addrs[i + LPM_AHEAD] >> 16]);
+    idx[i] = lpm_lookup(lpm, addrs[i]);
+  }
+}
@@ -0,0 +1,75 @@
+/*********************************************************
+ * lpm.h  --- Longest prefix match index of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef LPM_H
+#define LPM_H
+
+#include <stddef.h>
+#include "vlsm.h"
+
+/**
+ * maps addresses to the longest of a set of prefixes holding them, e.g.
+ * the subnets of a plan. A DIR-16-8-8 table: the first 16 bits of an
+ * address index a table of 2^16 entries, each one either the answer for
+ * the whole /16 or a chunk of 256 entries for the next 8 bits, and again
+ * for the last 8 bits. A lookup reads at most 3 entries; chunks exist
+ * only where a prefix longer than /16 (/24) starts or ends
+ */
+typedef struct lpm lpm_t;
+
+
+/**
+ * index the @n prefixes @subnets, which may overlap. Entries of mask 0,
+ * requirements of 0 host, match nothing
+ * Return NULL if out of memory or @n above LPM_MAXN
+ */
+#define LPM_MAXN    0x7ffffffe
+
+lpm_t               * lpm_new             (const network_t        * subnets,
+                                           int                      n);
+
+
+void                  lpm_free            (lpm_t                  * lpm);
+
+
+/**
+ * RETURN the index in @subnets of the longest prefix holding @addr, the
+ * first one of equal prefixes, or -1 if none does
+ */
+int                   lpm_lookup          (const lpm_t            * lpm,
+                                           ipv4u32_t                addr);
+
+
+/**
+ * lpm_lookup() of the @n @addrs to @idx. The first level entry of an
+ * address is prefetched a few lookups ahead of its turn
+ */
+void                  lpm_lookup_batch    (const lpm_t            * lpm,
+                                           const ipv4u32_t        * addrs,
+                                           int                    * idx,
+                                           size_t                   n);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
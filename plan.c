@@ -0,0 +1,308 @@
+/*********************************************************
+ * plan.c  --- Binary result files of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+#include "vlsm.h"
+#include "plan.h"
+
+
+/* little endian helpers */
+static void
+put_le32 (unsigned char * p,
+          uint32_t        v)
+{
+  p[0] = (unsigned char) v;
+  p[1] = (unsigned char)(v >> 8);
+  p[2] = (unsigned char)(v >> 16);
+  p[3] = (unsigned char)(v >> 24);
+}
+
+static uint32_t
+get_le32 (const unsigned char * p)
+{
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8
+       | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+int
+plan_write (FILE               * out,
+            const network_t    * base,
+            const network_t    * subnets,
+            uint64_t             count,
+            unsigned int         recsize)
+{
+  unsigned char   buf[64 * 1024];
+  size_t          len = 0;
+  uint64_t        i;
+
+  if (recsize != PLAN_REC5 && recsize != PLAN_REC8) return -2;
+
+  /* header */
+  memset(buf, 0, PLAN_HEADERLEN);
+  memcpy(buf, PLAN_MAGIC, 4);
+  buf[4] = PLAN_VERSION;
+  buf[5] = (unsigned char)recsize;
+  buf[6] = base->mask;
+  ipv4cpy(buf + 8, base->addr);
+  put_le32(buf + 16, (uint32_t)count);
+  put_le32(buf + 20, (uint32_t)(count >> 32));
+  len = PLAN_HEADERLEN;
+
+  /* records */
+  for (i=0;i<count;i++) {
+    unsigned char * rec = buf + len;
+    if (recsize == PLAN_REC5) {
+      ipv4cpy(rec, subnets[i].addr);
+      rec[4] = subnets[i].mask;
+    } else {
+      put_le32(rec, ipv4tou32(subnets[i].addr));
+      rec[4] = subnets[i].mask;
+      rec[5] = rec[6] = rec[7] = 0;
+    }
+    len += recsize;
+    if (sizeof(buf) - len < PLAN_REC8) {
+      if (fwrite(buf, 1, len, out) != len) return -1;
+      len = 0;
+    }
+  }
+  if (fwrite(buf, 1, len, out) != len) return -1;
+  return 0;
+}
+
+
+int
+plan_open (plan_t        * plan,
+           const char    * path)
+{
+  FILE                * f;
+  const unsigned char * p;
+  long                  size;
+
+  memset(plan, 0, sizeof(*plan));
+  f = fopen(path, "rb");
+  if (f == NULL) return -1;
+  if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0) {
+    fclose(f);
+    return -1;
+  }
+  plan->datalen = (size_t)size;
+
+#ifndef _WIN32
+  if (size > 0) {
+    void * m = mmap(NULL, plan->datalen, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    if (m != MAP_FAILED) {
+      plan->data = m;
+      plan->mapped = 1;
+    }
+  }
+#endif
+  if (!plan->mapped) {
+    plan->data = malloc(plan->datalen ? plan->datalen : 1);
+    rewind(f);
+    if (plan->data == NULL
+     || fread(plan->data, 1, plan->datalen, f) != plan->datalen)
+    {
+      fclose(f);
+      plan_close(plan);
+      return -1;
+    }
+  }
+  fclose(f);
+
+  /* header */
+  p = (const unsigned char *)plan->data;
+  if (plan->datalen < PLAN_HEADERLEN || memcmp(p, PLAN_MAGIC, 4) != 0
+   || p[4] != PLAN_VERSION || (p[5] != PLAN_REC5 && p[5] != PLAN_REC8))
+  {
+    plan_close(plan);
+    return -2;
+  }
+  plan->version = p[4];
+  plan->recsize = p[5];
+  makenetwork(&plan->base, p + 8, p[6]);
+  plan->count = (uint64_t)get_le32(p + 16) | (uint64_t)get_le32(p + 20) << 32;
+  if (plan->count > (plan->datalen - PLAN_HEADERLEN) / plan->recsize) {
+    plan_close(plan);
+    return -2;
+  }
+  plan->records = p + PLAN_HEADERLEN;
+  return 0;
+}
+
+
+void
+plan_close (plan_t * plan)
+{
+#ifndef _WIN32
+  if (plan->mapped) {
+    munmap(plan->data, plan->datalen);
+  } else
+#endif
+  free(plan->data);
+  memset(plan, 0, sizeof(*plan));
+}
+
+
+ipv4u32_t
+plan_addr (const plan_t  * plan,
+           uint64_t        i)
+{
+  const unsigned char * rec = plan->records + i * plan->recsize;
+  if (plan->recsize == PLAN_REC8) return get_le32(rec);
+  return ipv4tou32(rec);
+}
+
+
+unsigned char
+plan_mask (const plan_t  * plan,
+           uint64_t        i)
+{
+  return plan->records[i * plan->recsize + 4];
+}
+
+
+void
+plan_get (const plan_t   * plan,
+          uint64_t         i,
+          network_t      * subnet)
+{
+  u32toipv4(subnet->addr, plan_addr(plan, i));
+  subnet->mask = plan_mask(plan, i);
+}
+
+
+/* append @subnet to the array @*subnets of @*count entries, @*cap big */
+static int
+plan_append (network_t        ** subnets,
+             uint64_t          * count,
+             uint64_t          * cap,
+             const network_t   * subnet)
+{
+  if (*count == *cap) {
+    uint64_t    n = *cap ? *cap * 2 : 1024;
+    network_t * p = (network_t *) realloc (*subnets, sizeof(network_t) * n);
+    if (p == NULL) return 0;
+    *subnets = p;
+    *cap = n;
+  }
+  (*subnets)[(*count)++] = *subnet;
+  return 1;
+}
+
+
+/* the subnet at the start of @line, "a.b.c.d/m". RETURN 0 if there is none */
+static int
+plan_parse_line (const char   * line,
+                 network_t    * subnet)
+{
+  const char    * slash = line;
+  ipv4u32_t       addr;
+  unsigned char   err;
+  size_t          used;
+  unsigned int    mask = 0;
+
+  while (*slash != '/' && *slash != '\0') slash++;
+  if (*slash != '/' || slash == line
+   || ipv4parse(&addr, &err, 1, line, (size_t)(slash - line), &used) != 1
+   || err != IPV4_PARSE_OK || used != (size_t)(slash - line))
+  {
+    return 0;
+  }
+  for (line = slash + 1; *line >= '0' && *line <= '9' && mask <= IPV4_BITLEN; line++) {
+    mask = mask * 10 + (unsigned int)(*line - '0');
+  }
+  if (line == slash + 1 || mask > IPV4_BITLEN) return 0;
+  u32toipv4(subnet->addr, addr);
+  subnet->mask = (unsigned char)mask;
+  return 1;
+}
+
+
+int
+plan_read (const char     * path,
+           network_t     ** subnets,
+           uint64_t       * count)
+{
+  FILE          * in = stdin;
+  char            line[2 * NETWORK_LINELEN];
+  uint64_t        cap = 0;
+  int             whole = 1,
+                  ret = 0;
+
+  *subnets = NULL;
+  *count = 0;
+  if (path != NULL && strcmp(path, "-") != 0) {
+    unsigned char magic[4];
+    size_t        got;
+
+    in = fopen(path, "rb");
+    if (in == NULL) return -1;
+    got = fread(magic, 1, sizeof(magic), in);
+    if (got == sizeof(magic) && memcmp(magic, PLAN_MAGIC, 4) == 0) {
+      plan_t    plan;
+      uint64_t  i;
+
+      fclose(in);
+      ret = plan_open(&plan, path);
+      if (ret != 0) return ret;
+      *subnets = (network_t *) malloc (sizeof(network_t) * (plan.count ? plan.count : 1));
+      if (*subnets == NULL) {
+        plan_close(&plan);
+        return -3;
+      }
+      for (i=0;i<plan.count;i++) plan_get(&plan, i, &(*subnets)[i]);
+      *count = plan.count;
+      plan_close(&plan);
+      return 0;
+    }
+    rewind(in);
+  }
+
+  /* text, a line may be longer than the buffer */
+  while (ret == 0 && fgets(line, sizeof(line), in) != NULL) {
+    size_t      len = strlen(line);
+    const char  * s = line;
+    network_t   subnet;
+    int         start = whole;
+
+    whole = len > 0 && line[len-1] == '\n';
+    if (!start) continue;
+    while (*s == ' ' || *s == '\t') s++;
+    if (*s == '#' || *s == '\n' || *s == '\r' || *s == '\0') continue;
+    if (!plan_parse_line(s, &subnet)) ret = -2;
+    else if (!plan_append(subnets, count, &cap, &subnet)) ret = -3;
+  }
+  if (ret == 0 && ferror(in)) ret = -1;
+  if (in != stdin) fclose(in);
+  if (ret != 0) {
+    free(*subnets);
+    *subnets = NULL;
+    *count = 0;
+  }
+  return ret;
+}
@@ -0,0 +1,148 @@
+/*********************************************************
+ * plan.h  --- Binary result files of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef PLAN_H
+#define PLAN_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "vlsm.h"
+
+/**
+ * File layout, all integers little endian:
+ *
+ *   offset  size  header
+ *        0     4  magic "VLSB"
+ *        4     1  version (PLAN_VERSION)
+ *        5     1  record size, 5 or 8
+ *        6     1  base network mask
+ *        7     1  reserved, 0
+ *        8     4  base network address, a.b.c.d as bytes a,b,c,d
+ *       12     4  reserved, 0
+ *       16     8  number of records
+ *       24     8  reserved, 0
+ *
+ *   then one record per subnet, in the order of the host requirements:
+ *     5 bytes: address as bytes a,b,c,d; mask        (same as network_t)
+ *     8 bytes: address as uint32_t; mask; 3 bytes 0  (aligned)
+ *   A record with mask 0 is a requirement of 0 hosts that got no subnet.
+ */
+#define PLAN_MAGIC        "VLSB"
+#define PLAN_VERSION      1
+#define PLAN_HEADERLEN    32
+#define PLAN_REC5         5
+#define PLAN_REC8         8
+
+
+/**
+ * an open result file, see plan_open()
+ */
+typedef struct
+{
+  network_t             base;
+  unsigned int          version;
+  unsigned int          recsize;    /* PLAN_REC5 or PLAN_REC8 */
+  uint64_t              count;      /* number of records */
+  const unsigned char * records;
+
+  /* private */
+  void                * data;
+  size_t                datalen;
+  int                   mapped;
+} plan_t;
+
+
+/**
+ * write @count subnets as a result file of @recsize records to @out
+ * Return:
+ *    0 : Successful
+ *   -1 : write error
+ *   -2 : invalid @recsize
+ */
+int                   plan_write          (FILE               * out,
+                                           const network_t    * base,
+                                           const network_t    * subnets,
+                                           uint64_t             count,
+                                           unsigned int         recsize);
+
+
+/**
+ * open the result file @path for reading. The file is memory-mapped when
+ * possible, records are used in place without any parsing
+ * Return:
+ *    0 : Successful
+ *   -1 : cannot open/read @path
+ *   -2 : not a result file, or unsupported version
+ */
+int                   plan_open           (plan_t             * plan,
+                                           const char         * path);
+
+
+/**
+ * release everything held by @plan
+ */
+void                  plan_close          (plan_t             * plan);
+
+
+/**
+ * RETURN the address of record @i of @plan
+ */
+ipv4u32_t             plan_addr           (const plan_t       * plan,
+                                           uint64_t             i);
+
+
+/**
+ * RETURN the mask of record @i of @plan
+ */
+unsigned char         plan_mask           (const plan_t       * plan,
+                                           uint64_t             i);
+
+
+/**
+ * store record @i of @plan to @subnet
+ */
+void                  plan_get            (const plan_t       * plan,
+                                           uint64_t             i,
+                                           network_t          * subnet);
+
+
+/**
+ * read every subnet of the plan @path, or of stdin if @path is NULL or
+ * "-", into a new array @*subnets of @*count entries for the caller to
+ * free(). A plan is a result file, or the text of print_plan(): lines
+ * that start with "a.b.c.d/m", other lines starting with '#' are skipped.
+ * Records of a result file are all kept in order, even those of mask 0
+ * Return:
+ *    0 : Successful
+ *   -1 : cannot open/read @path
+ *   -2 : not a plan
+ *   -3 : out of memory
+ */
+int                   plan_read           (const char         * path,
+                                           network_t         ** subnets,
+                                           uint64_t           * count);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
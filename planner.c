@@ -0,0 +1,463 @@
+/*********************************************************
+ * planner.c  --- Incremental VLSM planner of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include "vlsm.h"
+#include "snapshot.h"
+#include "ipam.h"
+#include "planner.h"
+#include "stats.h"
+
+
+struct planner
+{
+  ipam_t          * ipam;
+  network_t         base;
+  unsigned char     net_mask;
+  int               n,
+                    cap;
+  unsigned long   * nhosts;
+  network_t       * subnets;    /* mask 0: no subnet */
+  int               in_image;   /* nhosts and subnets live in snap */
+  snap_t            snap;       /* opened by planner_load() */
+};
+
+
+planner_t *
+planner_new (const ipv4_t     net_addr,
+             unsigned char    net_mask)
+{
+  planner_t * planner;
+  network_t   base;
+
+  if (net_mask > 30 || net_mask <= 0) return NULL;
+  makenetwork(&base, net_addr, net_mask);
+  ipv4tonet(base.addr, net_addr, net_mask);
+
+  planner = (planner_t *) calloc (1, sizeof(planner_t));
+  if (planner == NULL) return NULL;
+  planner->base = base;
+  planner->net_mask = net_mask;
+  planner->ipam = ipam_new(&base);
+  if (planner->ipam == NULL) {
+    planner_free(planner);
+    return NULL;
+  }
+  return planner;
+}
+
+
+void
+planner_free (planner_t * planner)
+{
+  if (planner == NULL) return;
+  ipam_free(planner->ipam);
+  if (!planner->in_image) {
+    free(planner->nhosts);
+    free(planner->subnets);
+  }
+  snap_close(&planner->snap);
+  free(planner);
+}
+
+
+int
+planner_count (const planner_t * planner)
+{
+  return planner->n;
+}
+
+
+const network_t *
+planner_subnet (const planner_t  * planner,
+                int                index)
+{
+  return &planner->subnets[index];
+}
+
+
+/* make room for @n requirements, new ones have no subnet */
+static int
+planner_reserve (planner_t  * planner,
+                 int          n)
+{
+  if (n > planner->cap) {
+    int             cap = planner->cap ? planner->cap : 64;
+    unsigned long * nhosts;
+    network_t     * subnets;
+    while (cap < n) cap *= 2;
+    if (planner->in_image) {
+      /* copy on write: a snapshot cannot grow */
+      nhosts = (unsigned long *) malloc (sizeof(unsigned long) * cap);
+      subnets = (network_t *) malloc (sizeof(network_t) * cap);
+      if (nhosts == NULL || subnets == NULL) {
+        free(nhosts);
+        free(subnets);
+        return 0;
+      }
+      memcpy(nhosts, planner->nhosts, sizeof(unsigned long) * planner->n);
+      memcpy(subnets, planner->subnets, sizeof(network_t) * planner->n);
+      planner->in_image = 0;
+    } else {
+      nhosts = (unsigned long *) realloc (planner->nhosts, sizeof(unsigned long) * cap);
+      if (nhosts == NULL) return 0;
+      planner->nhosts = nhosts;
+      subnets = (network_t *) realloc (planner->subnets, sizeof(network_t) * cap);
+      if (subnets == NULL) return 0;
+    }
+    planner->nhosts = nhosts;
+    planner->subnets = subnets;
+    planner->cap = cap;
+  }
+  while (planner->n < n) {
+    planner->nhosts[planner->n] = 0;
+    memset(&planner->subnets[planner->n], 0, sizeof(network_t));
+    planner->n++;
+  }
+  return 1;
+}
+
+
+static void
+set_change (planner_change_t  * change,
+            int                 op,
+            int                 index,
+            const network_t   * old_net,
+            const network_t   * new_net)
+{
+  if (change == NULL) return;
+  change->op = op;
+  change->index = index;
+  memcpy(&change->old_net, old_net, sizeof(network_t));
+  memcpy(&change->new_net, new_net, sizeof(network_t));
+}
+
+
+int
+planner_add (planner_t         * planner,
+             unsigned long       nhosts,
+             planner_change_t  * change)
+{
+  int index = planner->n;
+  int r;
+
+  if (!planner_reserve(planner, index + 1)) return -3;
+  r = planner_resize(planner, index, nhosts, change);
+  if (r < 0) {
+    planner->n--;
+    return r;
+  }
+  return index;
+}
+
+
+int
+planner_remove (planner_t         * planner,
+                int                 index,
+                planner_change_t  * change)
+{
+  return planner_resize(planner, index, 0, change);
+}
+
+
+int
+planner_resize (planner_t         * planner,
+                int                 index,
+                unsigned long       nhosts,
+                planner_change_t  * change)
+{
+  network_t       old_net,
+                  new_net;
+  unsigned char   new_mask = 0;
+  int             op,
+                  r = -2;
+
+  if (index < 0 || index >= planner->n) return -1;
+  if (nhosts > 0) {
+    new_mask = calmask(nhosts, planner->net_mask);
+    if (new_mask == 0) return -2;
+  }
+
+  old_net = planner->subnets[index];
+  set_change(change, PLANNER_NONE, index, &old_net, &old_net);
+  if (new_mask == old_net.mask) {
+    planner->nhosts[index] = nhosts;
+    return 0;
+  }
+
+  /* give the old block back first, it may be part of the new one */
+  if (old_net.mask != 0) ipam_release(planner->ipam, &old_net);
+
+  if (new_mask == 0) {
+    memset(&new_net, 0, sizeof(new_net));
+    op = PLANNER_REMOVE;
+  } else {
+    u32toipv4(new_net.addr, ipv4tou32(old_net.addr) & masktou32(new_mask));
+    new_net.mask = new_mask;
+    if (old_net.mask != 0 && (r = ipam_alloc_at(planner->ipam, &new_net)) == 0) {
+      op = PLANNER_RESIZE;
+    } else if (r != -3 && (r = ipam_alloc(planner->ipam, new_mask, &new_net)) == 0) {
+      op = (old_net.mask == 0) ? PLANNER_ADD : PLANNER_MOVE;
+    } else {
+      /* never fails, the release left the nodes to split it again */
+      if (old_net.mask != 0) ipam_alloc_at(planner->ipam, &old_net);
+      return (r == -3) ? -3 : -2;
+    }
+  }
+
+  planner->subnets[index] = new_net;
+  planner->nhosts[index] = nhosts;
+  set_change(change, op, index, &old_net, &new_net);
+  return 1;
+}
+
+
+/**
+ * planner_update() without the fallback. @changes may be NULL when the
+ * changes are not wanted
+ */
+static int
+planner_place (planner_t               * planner,
+               const unsigned long     * nhosts_arr,
+               int                       arrlen,
+               planner_change_t        * changes,
+               int                     * nchanges)
+{
+  int   count[IPV4_BITLEN + 1];
+  int   i,
+        m,
+        r,
+        nc = 0,
+        ret = 0;
+
+  /* requirements that go away */
+  STATS_BEGIN(t);
+  for (i=arrlen;i<planner->n;i++) {
+    if (planner_remove(planner, i, changes ? &changes[nc] : NULL) > 0) nc++;
+  }
+  if (planner->n > arrlen) planner->n = arrlen;
+  if (!planner_reserve(planner, arrlen)) {
+    *nchanges = nc;
+    return -3;
+  }
+
+  /* shrink first so the space is there for whatever grows */
+  memset(count, 0, sizeof(count));
+  for (i=0;i<arrlen;i++) {
+    unsigned char old_mask = planner->subnets[i].mask;
+    unsigned char new_mask = nhosts_arr[i] ? calmask(nhosts_arr[i], planner->net_mask) : 0;
+
+    if (nhosts_arr[i] != 0 && new_mask == 0) {
+      ret = -2;   /* will never fit */
+    } else if (new_mask == old_mask || (old_mask != 0 && (new_mask == 0 || new_mask > old_mask))) {
+      r = planner_resize(planner, i, nhosts_arr[i], changes ? &changes[nc] : NULL);
+      if (r == -3) {
+        *nchanges = nc;
+        return -3;
+      }
+      if (r > 0) nc++;
+    } else {
+      count[new_mask]++;
+    }
+  }
+
+  /* then grow and add, largest first */
+  for (m=planner->net_mask; m<=IPV4_BITLEN; m++) {
+    if (count[m] == 0) continue;
+    for (i=0;i<arrlen;i++) {
+      if (nhosts_arr[i] == 0 || planner->subnets[i].mask == m
+       || calmask(nhosts_arr[i], planner->net_mask) != m)
+      {
+        continue;
+      }
+      r = planner_resize(planner, i, nhosts_arr[i], changes ? &changes[nc] : NULL);
+      if (r == -3) {
+        *nchanges = nc;
+        return -3;
+      }
+      if (r == -2) ret = -2;
+      if (r > 0) nc++;
+    }
+  }
+
+  STATS_END(STATS_ALLOCATE, t);
+  *nchanges = nc;
+  return ret;
+}
+
+
+/**
+ * the plan as planner_update() would make it from nothing, put in place of
+ * @planner if the subnets fit that way. @changes holds the @nc changes
+ * made so far: those of requirements past @arrlen are kept, the others
+ * give way to one change per subnet that differs from where it was
+ * before the update
+ * Return: as planner_update()
+ */
+static int
+planner_repack (planner_t               * planner,
+                const unsigned long     * nhosts_arr,
+                int                       arrlen,
+                planner_change_t        * changes,
+                int                     * nchanges)
+{
+  planner_t   * fresh,
+                old;
+  network_t   * orig;
+  int           i,
+                k = 0,
+                nc = *nchanges,
+                r;
+
+  fresh = planner_new(planner->base.addr, planner->net_mask);
+  orig = (network_t *) malloc (sizeof(network_t) * (arrlen + 1));
+  if (fresh == NULL || orig == NULL) {
+    planner_free(fresh);
+    free(orig);
+    return -3;
+  }
+  r = planner_place(fresh, nhosts_arr, arrlen, NULL, &i);
+  if (r < 0) {
+    planner_free(fresh);
+    free(orig);
+    return r;
+  }
+
+  /* where every subnet was before the update */
+  memcpy(orig, planner->subnets, sizeof(network_t) * arrlen);
+  for (i=0;i<nc;i++) {
+    if (changes[i].index < arrlen) {
+      orig[changes[i].index] = changes[i].old_net;
+    } else {
+      changes[k++] = changes[i];
+    }
+  }
+
+  /* swap the fresh plan in, the old one goes with fresh */
+  old = *planner;
+  *planner = *fresh;
+  *fresh = old;
+  planner_free(fresh);
+
+  for (i=0;i<arrlen;i++) {
+    const network_t * net = &planner->subnets[i];
+    int op;
+    if (memcmp(&orig[i], net, sizeof(network_t)) == 0) continue;
+    if (orig[i].mask == 0) {
+      op = PLANNER_ADD;
+    } else if (net->mask == 0) {
+      op = PLANNER_REMOVE;
+    } else {
+      op = PLANNER_MOVE;
+    }
+    set_change(&changes[k++], op, i, &orig[i], net);
+  }
+  free(orig);
+  *nchanges = k;
+  return 0;
+}
+
+
+int
+planner_update (planner_t               * planner,
+                const unsigned long     * nhosts_arr,
+                int                       arrlen,
+                planner_change_t        * changes,
+                int                     * nchanges)
+{
+  int ret = planner_place(planner, nhosts_arr, arrlen, changes, nchanges);
+
+  /* the old subnets may be in the way of a plan that fits from nothing */
+  if (ret == -2) {
+    int r = planner_repack(planner, nhosts_arr, arrlen, changes, nchanges);
+    if (r != -2) ret = r;
+  }
+  return ret;
+}
+
+
+int
+planner_save (const planner_t  * planner,
+              FILE             * out)
+{
+  uint32_t      scratch[IPAM_IMAGE_WORDS],
+                count[2];
+  snap_part_t   parts[IPAM_IMAGE_PARTS + 3];
+  int           nparts = ipam_image_parts(planner->ipam, scratch, parts);
+
+  count[0] = (uint32_t)planner->n;
+  count[1] = 0;
+  parts[nparts].data = count;
+  parts[nparts++].len = sizeof(count);
+  parts[nparts].data = planner->nhosts;
+  parts[nparts++].len = sizeof(unsigned long) * planner->n;
+  parts[nparts].data = planner->subnets;
+  parts[nparts++].len = sizeof(network_t) * planner->n;
+
+  return snap_write(out, SNAP_PLANNER, 0, &planner->base, parts, nparts);
+}
+
+
+int
+planner_load (planner_t    ** planner,
+              const char    * path,
+              int             verify)
+{
+  planner_t       * p;
+  unsigned char   * image;
+  size_t            len,
+                    used;
+  uint32_t          n;
+  int               r;
+
+  *planner = NULL;
+  p = (planner_t *) calloc (1, sizeof(planner_t));
+  if (p == NULL) return -3;
+  r = snap_open(&p->snap, path, SNAP_PLANNER, verify);
+  if (r < 0) {
+    free(p);
+    return r;
+  }
+  p->base = p->snap.base;
+  p->net_mask = p->base.mask;
+  p->in_image = 1;
+
+  /* the pool, then the requirements */
+  image = p->snap.payload;
+  len = p->snap.payloadlen;
+  p->ipam = ipam_image_open(&p->base, image, len, &used);
+  if (p->ipam == NULL || len - used < 8) {
+    planner_free(p);
+    return -2;
+  }
+  image += used;
+  len -= used;
+  memcpy(&n, image, sizeof(n));
+  if (n > INT_MAX || (len - 8) / (sizeof(unsigned long) + sizeof(network_t)) < n) {
+    planner_free(p);
+    return -2;
+  }
+  p->n = p->cap = (int)n;
+  p->nhosts = (unsigned long *)(image + 8);
+  p->subnets = (network_t *)(image + 8 + SNAP_ALIGN(sizeof(unsigned long) * n));
+  *planner = p;
+  return 0;
+}
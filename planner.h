@@ -0,0 +1,176 @@
+/*********************************************************
+ * planner.h  --- Incremental VLSM planner of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <stdio.h>
+#include "vlsm.h"
+
+/**
+ * kinds of planner_change_t
+ */
+#define PLANNER_NONE      0   /* nothing changed */
+#define PLANNER_ADD       1   /* requirement got a subnet */
+#define PLANNER_REMOVE    2   /* requirement lost its subnet */
+#define PLANNER_RESIZE    3   /* new mask, new subnet contains the old one or vice versa */
+#define PLANNER_MOVE      4   /* subnet had to be renumbered */
+
+/**
+ * one subnet that changed because of an edit
+ */
+typedef struct
+{
+  int               op;         /* PLANNER_* */
+  int               index;      /* requirement index */
+  network_t         old_net;    /* mask 0 for PLANNER_ADD */
+  network_t         new_net;    /* mask 0 for PLANNER_REMOVE */
+} planner_change_t;
+
+/**
+ * a VLSM plan that is kept up to date edit by edit. Requirement i always
+ * keeps its subnet unless it is removed or has to grow and there is no
+ * room next to it, so unrelated subnets are never renumbered
+ * Every edit costs O(32) tree steps, independent of the plan size
+ */
+typedef struct planner planner_t;
+
+
+/**
+ * create an empty plan over the base network @net_addr/@net_mask (host
+ * bits of @net_addr cleared), the same address space vlsm() uses
+ * Return NULL if @net_mask is invalid or out of memory
+ */
+planner_t           * planner_new         (const ipv4_t             net_addr,
+                                           unsigned char            net_mask);
+
+
+void                  planner_free        (planner_t              * planner);
+
+
+/**
+ * number of requirements in the plan (removed ones included)
+ */
+int                   planner_count       (const planner_t        * planner);
+
+
+/**
+ * RETURN the subnet of requirement @index, mask 0 if it has none
+ */
+const network_t     * planner_subnet      (const planner_t        * planner,
+                                           int                      index);
+
+
+/**
+ * append a requirement of @nhosts hosts. @change may be NULL
+ * Return:
+ *   >=0 : index of the new requirement
+ *   -2  : no room for it in the base network (it is not appended)
+ *   -3  : out of memory
+ * a requirement of 0 host is appended without a subnet
+ */
+int                   planner_add         (planner_t              * planner,
+                                           unsigned long            nhosts,
+                                           planner_change_t       * change);
+
+
+/**
+ * release the subnet of requirement @index. The index stays valid, the
+ * requirement just has 0 hosts now. @change may be NULL
+ * Return: 1 if a subnet was released, 0 if there was none, -1 bad index
+ */
+int                   planner_remove      (planner_t              * planner,
+                                           int                      index,
+                                           planner_change_t       * change);
+
+
+/**
+ * change requirement @index to @nhosts hosts. A subnet shrinks in place,
+ * grows in place when the aligned block around it is free and moves
+ * otherwise. @change may be NULL, its op is PLANNER_NONE if the subnet
+ * stayed the same
+ * Return:
+ *    1  : the subnet changed
+ *    0  : nothing changed
+ *   -1  : bad index
+ *   -2  : no room, the old subnet is kept
+ *   -3  : out of memory, the old subnet is kept
+ */
+int                   planner_resize      (planner_t              * planner,
+                                           int                      index,
+                                           unsigned long            nhosts,
+                                           planner_change_t       * change);
+
+
+/**
+ * make the plan match @nhosts_arr: requirement i gets nhosts_arr[i],
+ * requirements beyond @arrlen are removed. Shrinks and removals go first,
+ * then growing and new subnets largest first, so a fresh plan packs as
+ * tightly as vlsm(). If the old subnets are in the way of some that
+ * would fit in a fresh plan, the whole plan is packed afresh instead and
+ * every subnet that is not where it was is reported, as PLANNER_MOVE if
+ * it had one. @changes must hold max(@arrlen, planner_count()) entries,
+ * *@nchanges receives how many were used
+ * Return:
+ *    0  : Successful
+ *   -2  : the requirements do not fit even in a fresh plan; those that
+ *         did not fit keep their previous subnet (mask 0 if they had none)
+ *   -3  : out of memory
+ */
+int                   planner_update      (planner_t              * planner,
+                                           const unsigned long    * nhosts_arr,
+                                           int                      arrlen,
+                                           planner_change_t       * changes,
+                                           int                    * nchanges);
+
+
+
+/**
+ * write @planner to @out as a snapshot, see snapshot.h
+ * Return: 0 if Successful, -1 write error
+ */
+int                   planner_save        (const planner_t        * planner,
+                                           FILE                   * out);
+
+
+/**
+ * open the snapshot @path written by planner_save() as *@planner. The plan
+ * is used straight from the mapped file instead of being solved again; only
+ * the links of the pool are bounds-checked, see ipam_load(). It can be
+ * edited right away: touched pages are copied by the kernel, and the
+ * arrays move to the heap the first time they have to grow. The checksum
+ * is only checked if @verify
+ * Return:
+ *    0 : Successful
+ *   -1 : cannot open/read @path
+ *   -2 : not a planner snapshot, or damaged
+ *   -3 : out of memory
+ */
+int                   planner_load        (planner_t             ** planner,
+                                           const char             * path,
+                                           int                      verify);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,213 @@
+/*********************************************************
+ * snapshot.c  --- Snapshot files of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+#include "vlsm.h"
+#include "snapshot.h"
+
+#define SNAP_BOM    0x01020304U
+
+
+/**
+ * Fletcher style checksum over 32-bit words. @len is a multiple of 4
+ * except at the very end of a part, where the missing bytes count as 0
+ */
+typedef struct
+{
+  uint64_t a,
+           b;
+} snap_sum_t;
+
+static void
+snap_sum (snap_sum_t           * sum,
+          const unsigned char  * p,
+          size_t                 len)
+{
+  uint64_t  a = sum->a,
+            b = sum->b;
+  uint32_t  w;
+
+  for (; len >= 4; p += 4, len -= 4) {
+    memcpy(&w, p, 4);
+    a += w;
+    b += a;
+  }
+  if (len > 0) {
+    w = 0;
+    memcpy(&w, p, len);
+    a += w;
+    b += a;
+  }
+  sum->a = a;
+  sum->b = b;
+}
+
+static uint64_t
+snap_sum_value (const snap_sum_t * sum)
+{
+  return sum->b << 32 ^ sum->a;
+}
+
+
+int
+snap_write (FILE               * out,
+            unsigned int         kind,
+            uint64_t             stamp,
+            const network_t    * base,
+            const snap_part_t  * parts,
+            int                  nparts)
+{
+  static const unsigned char  zeros[8] = {0};
+  unsigned char               header[SNAP_HEADERLEN];
+  uint32_t                    bom = SNAP_BOM;
+  uint64_t                    payloadlen = 0,
+                              checksum;
+  snap_sum_t                  sum = {0, 0};
+  int                         i;
+
+  for (i=0;i<nparts;i++) {
+    size_t pad = SNAP_ALIGN(parts[i].len) - parts[i].len;
+    snap_sum(&sum, (const unsigned char *)parts[i].data, parts[i].len);
+    snap_sum(&sum, zeros, pad & ~(size_t)3);   /* a partial word was padded already */
+    payloadlen += SNAP_ALIGN(parts[i].len);
+  }
+  checksum = snap_sum_value(&sum);
+
+  memset(header, 0, sizeof(header));
+  memcpy(header, SNAP_MAGIC, 4);
+  header[4] = SNAP_VERSION;
+  header[5] = (unsigned char)kind;
+  header[6] = base->mask;
+  header[7] = (unsigned char)sizeof(unsigned long);
+  ipv4cpy(header + 8, base->addr);
+  memcpy(header + 12, &bom, 4);
+  memcpy(header + 16, &payloadlen, 8);
+  memcpy(header + 24, &checksum, 8);
+  memcpy(header + 32, &stamp, 8);
+  if (fwrite(header, 1, sizeof(header), out) != sizeof(header)) return -1;
+
+  for (i=0;i<nparts;i++) {
+    size_t pad = SNAP_ALIGN(parts[i].len) - parts[i].len;
+    if (fwrite(parts[i].data, 1, parts[i].len, out) != parts[i].len
+     || fwrite(zeros, 1, pad, out) != pad)
+    {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+
+int
+snap_open (snap_t        * snap,
+           const char    * path,
+           unsigned int    kind,
+           int             verify)
+{
+  FILE                * f;
+  const unsigned char * p;
+  uint32_t              bom;
+  uint64_t              payloadlen,
+                        checksum;
+  long                  size;
+
+  memset(snap, 0, sizeof(*snap));
+  f = fopen(path, "rb");
+  if (f == NULL) return -1;
+  if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0) {
+    fclose(f);
+    return -1;
+  }
+  snap->datalen = (size_t)size;
+
+#ifndef _WIN32
+  if (size > 0) {
+    void * m = mmap(NULL, snap->datalen, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(f), 0);
+    if (m != MAP_FAILED) {
+      snap->data = m;
+      snap->mapped = 1;
+    }
+  }
+#endif
+  if (!snap->mapped) {
+    snap->data = malloc(snap->datalen ? snap->datalen : 1);
+    rewind(f);
+    if (snap->data == NULL
+     || fread(snap->data, 1, snap->datalen, f) != snap->datalen)
+    {
+      fclose(f);
+      snap_close(snap);
+      return -1;
+    }
+  }
+  fclose(f);
+
+  /* header */
+  p = (const unsigned char *)snap->data;
+  if (snap->datalen < SNAP_HEADERLEN) {
+    snap_close(snap);
+    return -2;
+  }
+  memcpy(&bom, p + 12, 4);
+  memcpy(&payloadlen, p + 16, 8);
+  memcpy(&checksum, p + 24, 8);
+  if (memcmp(p, SNAP_MAGIC, 4) != 0 || p[4] != SNAP_VERSION || p[5] != kind
+   || p[7] != sizeof(unsigned long) || bom != SNAP_BOM || p[6] > IPV4_BITLEN
+   || payloadlen > snap->datalen - SNAP_HEADERLEN)
+  {
+    snap_close(snap);
+    return -2;
+  }
+  snap->kind = p[5];
+  memcpy(&snap->stamp, p + 32, 8);
+  makenetwork(&snap->base, p + 8, p[6]);
+  snap->payload = (unsigned char *)snap->data + SNAP_HEADERLEN;
+  snap->payloadlen = (size_t)payloadlen;
+
+  if (verify) {
+    snap_sum_t sum = {0, 0};
+    snap_sum(&sum, snap->payload, snap->payloadlen);
+    if (snap_sum_value(&sum) != checksum) {
+      snap_close(snap);
+      return -2;
+    }
+  }
+  return 0;
+}
+
+
+void
+snap_close (snap_t * snap)
+{
+#ifndef _WIN32
+  if (snap->mapped) {
+    munmap(snap->data, snap->datalen);
+  } else
+#endif
+  free(snap->data);
+  memset(snap, 0, sizeof(*snap));
+}
@@ -0,0 +1,129 @@
+/*********************************************************
+ * snapshot.h  --- Snapshot files of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "vlsm.h"
+
+/**
+ * A snapshot holds the allocation state of an ipam_t or planner_t exactly
+ * as it is in memory, so it is used in place after mmap() with nothing to
+ * parse. Its structures refer to each other by index, never by pointer,
+ * so the file works at any address. Integers are in host byte order; a
+ * file from a host of the other byte order or word size is refused.
+ *
+ *   offset  size  header
+ *        0     4  magic "VLSS"
+ *        4     1  version (SNAP_VERSION)
+ *        5     1  kind, SNAP_IPAM or SNAP_PLANNER
+ *        6     1  base network mask
+ *        7     1  sizeof(unsigned long)
+ *        8     4  base network address, a.b.c.d as bytes a,b,c,d
+ *       12     4  0x01020304
+ *       16     8  payload length
+ *       24     8  checksum of the payload
+ *       32     8  stamp, what the writer wants to know the snapshot by
+ *                 (journal.c: the generation of the first log after it)
+ *       40    24  reserved, 0
+ *
+ *   then the payload: the parts given to snap_write(), each one padded
+ *   with 0 to a multiple of 8 bytes
+ */
+#define SNAP_MAGIC        "VLSS"
+#define SNAP_VERSION      1
+#define SNAP_HEADERLEN    64
+#define SNAP_IPAM         1
+#define SNAP_PLANNER      2
+
+#define SNAP_ALIGN(len)   (((len) + 7) & ~(size_t)7)
+
+
+/**
+ * one piece of a payload, see snap_write()
+ */
+typedef struct
+{
+  const void          * data;
+  size_t                len;
+} snap_part_t;
+
+
+/**
+ * an open snapshot, see snap_open()
+ */
+typedef struct
+{
+  network_t             base;
+  unsigned int          kind;
+  uint64_t              stamp;
+  unsigned char       * payload;    /* writable, see snap_open() */
+  size_t                payloadlen;
+
+  /* private */
+  void                * data;
+  size_t                datalen;
+  int                   mapped;
+} snap_t;
+
+
+/**
+ * write a snapshot of @kind whose payload is the @nparts @parts to @out
+ * Return: 0 if Successful, -1 write error
+ */
+int                   snap_write          (FILE               * out,
+                                           unsigned int         kind,
+                                           uint64_t             stamp,
+                                           const network_t    * base,
+                                           const snap_part_t  * parts,
+                                           int                  nparts);
+
+
+/**
+ * open the snapshot @path of @kind. The file is mapped privately when
+ * possible: pages are shared with the page cache until something writes
+ * to them, then the kernel copies just those pages and the file itself
+ * never changes. The payload is checked against its checksum only if
+ * @verify, which reads every page of it
+ * Return:
+ *    0 : Successful
+ *   -1 : cannot open/read @path
+ *   -2 : not a snapshot of @kind, made on another kind of host, or damaged
+ */
+int                   snap_open           (snap_t             * snap,
+                                           const char         * path,
+                                           unsigned int         kind,
+                                           int                  verify);
+
+
+/**
+ * release everything held by @snap. Does nothing to a zeroed snap_t
+ */
+void                  snap_close          (snap_t             * snap);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
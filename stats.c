@@ -0,0 +1,328 @@
+/*********************************************************
+ * stats.c  --- Solver instrumentation of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+#ifdef VLSM_STATS
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STATS_TSC   1
+#endif
+
+/**
+ * Job times go to a log-linear histogram: 8 buckets for each power of
+ * two, so a percentile is off by at most 1/8 and nothing is allocated
+ */
+#define HIST_SUB    8
+#define HIST_LEN    (64 * HIST_SUB)
+
+typedef struct
+{
+  uint64_t    start,
+              dur;
+  int         phase;    /* STATS_NPHASES for a job */
+  int         tid;
+} event_t;
+
+static const char * const phase_name[STATS_NPHASES + 1] = {
+  "parse", "check", "allocate", "format", "job"
+};
+
+int                 stats_on;
+
+static uint64_t     calls[STATS_NPHASES + 1],
+                    ticks[STATS_NPHASES + 1],
+                    hist[HIST_LEN],
+                    job_max,
+                    nmallocs,
+                    malloc_bytes;
+
+/* the cycle counter against the clock since stats_enable() */
+static uint64_t     tick0;
+static double       ns0;
+
+static event_t    * events;
+static uint64_t     nevents;
+static char       * trace_path;
+static int          ntids;
+static __thread int tid;
+
+
+static double
+clock_ns (void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+
+uint64_t
+stats_now (void)
+{
+#ifdef STATS_TSC
+  return __builtin_ia32_rdtsc();
+#else
+  return (uint64_t)clock_ns();
+#endif
+}
+
+
+/* RETURN ns per tick */
+static double
+tick_ns (void)
+{
+#ifdef STATS_TSC
+  uint64_t  t = stats_now() - tick0;
+  double    ns = clock_ns() - ns0;
+  return (t > 0 && ns > 0) ? ns / t : 1;
+#else
+  return 1;
+#endif
+}
+
+
+static void
+add_event (int        phase,
+           uint64_t   start,
+           uint64_t   dur)
+{
+  uint64_t i;
+
+  if (events == NULL) return;
+  if (tid == 0) tid = __atomic_add_fetch(&ntids, 1, __ATOMIC_RELAXED);
+  i = __atomic_fetch_add(&nevents, 1, __ATOMIC_RELAXED);
+  if (i >= STATS_TRACE_MAX) return;
+  events[i].start = start;
+  events[i].dur = dur;
+  events[i].phase = phase;
+  events[i].tid = tid;
+}
+
+
+void
+stats_add (int        phase,
+           uint64_t   start)
+{
+  uint64_t dur = stats_now() - start;
+  __atomic_fetch_add(&calls[phase], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&ticks[phase], dur, __ATOMIC_RELAXED);
+  add_event(phase, start, dur);
+}
+
+
+static int
+hist_index (uint64_t t)
+{
+  int e;
+  if (t < HIST_SUB) return (int)t;
+  e = 63 - __builtin_clzll(t);    /* >= 3 */
+  return (e - 2) * HIST_SUB + (int)((t >> (e - 3)) & (HIST_SUB - 1));
+}
+
+/* smallest time of bucket @i */
+static uint64_t
+hist_value (int i)
+{
+  if (i < HIST_SUB) return (uint64_t)i;
+  return (uint64_t)(HIST_SUB + i % HIST_SUB) << (i / HIST_SUB - 1);
+}
+
+
+void
+stats_job (uint64_t start)
+{
+  uint64_t dur = stats_now() - start,
+           max = __atomic_load_n(&job_max, __ATOMIC_RELAXED);
+
+  __atomic_fetch_add(&calls[STATS_NPHASES], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&ticks[STATS_NPHASES], dur, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&hist[hist_index(dur)], 1, __ATOMIC_RELAXED);
+  while (dur > max && !__atomic_compare_exchange_n(&job_max, &max, dur, 1,
+                                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+  add_event(STATS_NPHASES, start, dur);
+}
+
+
+void
+stats_malloc (size_t bytes)
+{
+  __atomic_fetch_add(&nmallocs, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&malloc_bytes, (uint64_t)bytes, __ATOMIC_RELAXED);
+}
+
+
+int
+stats_enable (const char * path)
+{
+  if (path != NULL) {
+    events = (event_t *) malloc (sizeof(event_t) * STATS_TRACE_MAX);
+    trace_path = (char *) malloc (strlen(path) + 1);
+    if (events == NULL || trace_path == NULL) {
+      free(events);
+      free(trace_path);
+      events = NULL;
+      trace_path = NULL;
+      return -3;
+    }
+    strcpy(trace_path, path);
+  }
+  tick0 = stats_now();
+  ns0 = clock_ns();
+  stats_on = 1;
+  return 0;
+}
+
+
+void
+stats_reset (void)
+{
+  memset(calls, 0, sizeof(calls));
+  memset(ticks, 0, sizeof(ticks));
+  memset(hist, 0, sizeof(hist));
+  job_max = 0;
+  nmallocs = 0;
+  malloc_bytes = 0;
+}
+
+
+/* RETURN the job time in ns below which @pct percent of the jobs are */
+static double
+percentile (double pct,
+            double ns)
+{
+  uint64_t  want = (uint64_t)(calls[STATS_NPHASES] * pct / 100 + 0.5),
+            seen = 0;
+  int       i;
+
+  if (want == 0) want = 1;
+  for (i=0;i<HIST_LEN;i++) {
+    seen += hist[i];
+    if (seen >= want) break;
+  }
+  if (i == HIST_LEN) return job_max * ns;
+  /* the middle of the bucket, but never above the slowest job */
+  {
+    double v = (hist_value(i) + hist_value(i + 1)) / 2.0 * ns;
+    return (v > job_max * ns) ? job_max * ns : v;
+  }
+}
+
+
+static int
+write_trace (double ns)
+{
+  FILE     * f = fopen(trace_path, "w");
+  uint64_t   n = nevents < STATS_TRACE_MAX ? nevents : STATS_TRACE_MAX,
+             i;
+
+  if (f == NULL) return -1;
+  fprintf(f, "{\"traceEvents\":[\n");
+  for (i=0;i<n;i++) {
+    const event_t * e = &events[i];
+    fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}\n",
+            i ? "," : "", phase_name[e->phase], e->tid,
+            (double)(e->start - tick0) * ns / 1000, e->dur * ns / 1000);
+  }
+  fprintf(f, "],\"displayTimeUnit\":\"ns\"}\n");
+  return fclose(f) == 0 ? 0 : -1;
+}
+
+
+int
+stats_report (FILE * out)
+{
+  double  ns = tick_ns();
+  int     i;
+
+  fprintf(out, "## stats: phase        calls     total_ms      avg_ns\n");
+  for (i=0;i<=STATS_NPHASES;i++) {
+    fprintf(out, "## stats: %-8s %10llu %12.3f %11.1f\n", phase_name[i],
+            (unsigned long long)calls[i], ticks[i] * ns / 1e6,
+            calls[i] ? ticks[i] * ns / calls[i] : 0.0);
+  }
+  if (calls[STATS_NPHASES]) {
+    fprintf(out, "## stats: job ns p50 %.0f p90 %.0f p99 %.0f max %.0f\n",
+            percentile(50, ns), percentile(90, ns), percentile(99, ns), job_max * ns);
+  }
+  fprintf(out, "## stats: %llu heap allocations, %llu bytes\n",
+          (unsigned long long)nmallocs, (unsigned long long)malloc_bytes);
+  if (trace_path != NULL) {
+    fprintf(out, "## stats: %llu trace events to %s",
+            (unsigned long long)(nevents < STATS_TRACE_MAX ? nevents : STATS_TRACE_MAX), trace_path);
+    if (nevents > STATS_TRACE_MAX) {
+      fprintf(out, ", %llu dropped", (unsigned long long)(nevents - STATS_TRACE_MAX));
+    }
+    fprintf(out, "\n");
+    if (write_trace(ns) != 0) return -1;
+  }
+  return 0;
+}
+
+
+void
+stats_summary (char    * buf,
+               size_t    len)
+{
+  double ns = tick_ns();
+
+  if (len == 0) return;
+  buf[0] = '\0';
+  if (!stats_on) return;
+  snprintf(buf, len, "parse %.2f ms, check %.2f ms, allocate %.2f ms, format %.2f ms, %llu allocs",
+           ticks[STATS_PARSE] * ns / 1e6, ticks[STATS_CHECK] * ns / 1e6,
+           ticks[STATS_ALLOCATE] * ns / 1e6, ticks[STATS_FORMAT] * ns / 1e6,
+           (unsigned long long)nmallocs);
+}
+
+#else   /* VLSM_STATS */
+
+int
+stats_enable (const char * trace_path)
+{
+  (void)trace_path;
+  return -1;
+}
+
+void
+stats_reset (void)
+{
+}
+
+int
+stats_report (FILE * out)
+{
+  (void)out;
+  return 0;
+}
+
+void
+stats_summary (char    * buf,
+               size_t    len)
+{
+  if (len > 0) buf[0] = '\0';
+}
+
+#endif
@@ -0,0 +1,119 @@
+/*********************************************************
+ * stats.h  --- Solver instrumentation of VLSM Solver program
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Counters and timers around the phases of a solve, built only with
+ * VLSM_STATS defined (make STATS=1); otherwise every STATS_* macro is
+ * empty and costs nothing. Even when built in they do nothing but test
+ * a flag until stats_enable() is called.
+ *
+ * A phase is timed as
+ *     STATS_BEGIN(t);
+ *     ... work ...
+ *     STATS_END(STATS_PARSE, t);
+ * and a whole job (one solved problem) with STATS_JOB(t) instead of
+ * STATS_END(). Time is read from the CPU cycle counter where there is
+ * one, and turned into ns against the clock when reported. Everything is
+ * safe to call from many threads.
+ */
+#define STATS_PARSE       0   /* text to base network and host counts */
+#define STATS_CHECK       1   /* required prefixes, does it fit */
+#define STATS_ALLOCATE    2   /* placing the subnets */
+#define STATS_FORMAT      3   /* subnets to text or to the view */
+#define STATS_NPHASES     4
+
+/* events kept for the trace file, later ones are dropped */
+#define STATS_TRACE_MAX   (1 << 20)
+
+#ifdef VLSM_STATS
+
+extern int            stats_on;
+
+uint64_t              stats_now           (void);
+
+void                  stats_add           (int                      phase,
+                                           uint64_t                 start);
+
+void                  stats_job           (uint64_t                 start);
+
+void                  stats_malloc        (size_t                   bytes);
+
+#define STATS_BEGIN(t)        uint64_t t = stats_on ? stats_now() : 0
+#define STATS_END(phase, t)   do { if (stats_on) stats_add((phase), (t)); } while (0)
+#define STATS_JOB(t)          do { if (stats_on) stats_job(t); } while (0)
+#define STATS_MALLOC(bytes)   do { if (stats_on) stats_malloc(bytes); } while (0)
+
+#else
+
+#define STATS_BEGIN(t)        ((void)0)
+#define STATS_END(phase, t)   ((void)0)
+#define STATS_JOB(t)          ((void)0)
+#define STATS_MALLOC(bytes)   ((void)0)
+
+#endif
+
+
+/**
+ * start counting. If @trace_path is not NULL, the phases are also
+ * written there as a Chrome trace (chrome://tracing, Perfetto) by
+ * stats_report()
+ * Return:
+ *    0 : Successful
+ *   -1 : built without VLSM_STATS
+ *   -3 : out of memory for the trace
+ */
+int                   stats_enable        (const char             * trace_path);
+
+
+/**
+ * forget what was counted so far, but not the trace
+ */
+void                  stats_reset         (void);
+
+
+/**
+ * print the totals of every phase, percentiles of the job times and the
+ * heap allocations to @out as "##" lines, and write the trace file
+ * Return: 0 if Successful, -1 if the trace file cannot be written
+ */
+int                   stats_report        (FILE                   * out);
+
+
+/**
+ * one line summary of the counts for a status bar, at most @len bytes
+ * with the \0. Empty if stats are not enabled
+ */
+void                  stats_summary       (char                   * buf,
+                                           size_t                   len);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,237 @@
+/*********************************************************
+ * GTK subnet list model for VLSM Solver
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+#include <stdio.h>
+#include <string.h>
+#include "subnet_model.h"
+
+static void subnet_model_tree_model_init (GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (SubnetModel, subnet_model, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+                                                subnet_model_tree_model_init))
+
+
+/**
+ * row of @iter, -1 if it is not an iter of @model as it is now
+ */
+static int iter_row (SubnetModel *model, GtkTreeIter *iter)
+{
+  int row;
+
+  if (iter == NULL || iter->stamp != model->stamp) return -1;
+  row = GPOINTER_TO_INT (iter->user_data);
+  return (row < model->n) ? row : -1;
+}
+
+/**
+ * point @iter to @row, RETURN FALSE if there is no such row
+ */
+static gboolean set_iter (SubnetModel *model, GtkTreeIter *iter, int row)
+{
+  if (row < 0 || row >= model->n) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+  iter->stamp = model->stamp;
+  iter->user_data = GINT_TO_POINTER (row);
+  iter->user_data2 = NULL;
+  iter->user_data3 = NULL;
+  return TRUE;
+}
+
+
+static GtkTreeModelFlags get_flags (GtkTreeModel *tree_model)
+{
+  return GTK_TREE_MODEL_LIST_ONLY | GTK_TREE_MODEL_ITERS_PERSIST;
+}
+
+static gint get_n_columns (GtkTreeModel *tree_model)
+{
+  return NUM_COLS;
+}
+
+static GType get_column_type (GtkTreeModel *tree_model, gint index)
+{
+  return G_TYPE_STRING;
+}
+
+static gboolean get_iter (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path)
+{
+  if (gtk_tree_path_get_depth (path) != 1) return FALSE;
+  return set_iter (SUBNET_MODEL (tree_model), iter, gtk_tree_path_get_indices (path)[0]);
+}
+
+static GtkTreePath * get_path (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  int row = iter_row (SUBNET_MODEL (tree_model), iter);
+
+  if (row < 0) return NULL;
+  return gtk_tree_path_new_from_indices (row, -1);
+}
+
+/**
+ * the text of one cell, made here every time the view asks for it
+ */
+static void get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value)
+{
+  SubnetModel     *model = SUBNET_MODEL (tree_model);
+  const network_t *net;
+  int              row = iter_row (model, iter),
+                   i;
+  ipv4_t           tmpaddr;
+  ipv4u32_t        addr;
+  char             str[32];
+
+  g_value_init (value, G_TYPE_STRING);
+  if (row < 0) return;
+  i = (model->rows != NULL) ? model->rows[row] : row;
+  net = &model->subnets[i];
+  addr = ipv4tou32 (net->addr);
+
+  if (column == COL_NAME) {
+    sprintf (str, "Subnet %lu", model->nhosts[i]);
+  } else if (column == COL_ADDR) {
+    ipv4tostr (str, net->addr);
+    sprintf (str + strlen (str), " /%u", net->mask);
+  } else if (column == COL_DMASK) {
+    u32toipv4 (tmpaddr, masktou32 (net->mask));
+    ipv4tostr (str, tmpaddr);
+  } else if (column == COL_FHOST) {
+    u32toipv4 (tmpaddr, calfirst32 (addr, net->mask));
+    ipv4tostr (str, tmpaddr);
+  } else if (column == COL_LHOST) {
+    u32toipv4 (tmpaddr, callast32 (addr, net->mask));
+    ipv4tostr (str, tmpaddr);
+  } else if (column == COL_BCAST) {
+    u32toipv4 (tmpaddr, calbroadcast32 (addr, net->mask));
+    ipv4tostr (str, tmpaddr);
+  } else {
+    return;
+  }
+  g_value_set_string (value, str);
+}
+
+static gboolean iter_next (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  SubnetModel *model = SUBNET_MODEL (tree_model);
+  int row = iter_row (model, iter);
+
+  return set_iter (model, iter, (row < 0) ? -1 : row + 1);
+}
+
+static gboolean iter_nth_child (GtkTreeModel *tree_model, GtkTreeIter *iter,
+                                GtkTreeIter *parent, gint n)
+{
+  SubnetModel *model = SUBNET_MODEL (tree_model);
+
+  return set_iter (model, iter, (parent == NULL) ? n : -1);
+}
+
+static gboolean iter_children (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent)
+{
+  return iter_nth_child (tree_model, iter, parent, 0);
+}
+
+static gboolean iter_has_child (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  return FALSE;
+}
+
+static gint iter_n_children (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  return (iter == NULL) ? SUBNET_MODEL (tree_model)->n : 0;
+}
+
+static gboolean iter_parent (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child)
+{
+  iter->stamp = 0;
+  return FALSE;
+}
+
+
+static void subnet_model_tree_model_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags = get_flags;
+  iface->get_n_columns = get_n_columns;
+  iface->get_column_type = get_column_type;
+  iface->get_iter = get_iter;
+  iface->get_path = get_path;
+  iface->get_value = get_value;
+  iface->iter_next = iter_next;
+  iface->iter_children = iter_children;
+  iface->iter_has_child = iter_has_child;
+  iface->iter_n_children = iter_n_children;
+  iface->iter_nth_child = iter_nth_child;
+  iface->iter_parent = iter_parent;
+}
+
+static void subnet_model_finalize (GObject *object)
+{
+  g_free (SUBNET_MODEL (object)->rows);
+  G_OBJECT_CLASS (subnet_model_parent_class)->finalize (object);
+}
+
+static void subnet_model_class_init (SubnetModelClass *klass)
+{
+  G_OBJECT_CLASS (klass)->finalize = subnet_model_finalize;
+}
+
+static void subnet_model_init (SubnetModel *model)
+{
+  model->subnets = NULL;
+  model->nhosts = NULL;
+  model->rows = NULL;
+  model->n = 0;
+  model->stamp = g_random_int ();
+}
+
+
+SubnetModel* subnet_model_new (void)
+{
+  return (SubnetModel *) g_object_new (SUBNET_TYPE_MODEL, NULL);
+}
+
+int subnet_model_set (SubnetModel *model,
+                      const network_t *subnets,
+                      const unsigned long *nhosts,
+                      int n)
+{
+  int i, hidden = 0;
+
+  g_free (model->rows);
+  model->rows = NULL;
+  model->n = 0;
+  model->stamp++;
+
+  /* a row map only if some subnet has to be hidden */
+  for (i=0;i<n;i++) {
+    if (nhosts[i] == 0) hidden++;
+  }
+  if (hidden > 0) {
+    int row = 0;
+    model->rows = (int *) g_try_malloc (sizeof(int) * (n - hidden + 1));
+    if (model->rows == NULL) return -3;
+    for (i=0;i<n;i++) {
+      if (nhosts[i] != 0) model->rows[row++] = i;
+    }
+  }
+  model->subnets = subnets;
+  model->nhosts = nhosts;
+  model->n = n - hidden;
+  return 0;
+}
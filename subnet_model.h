@@ -0,0 +1,85 @@
+/*********************************************************
+ * GTK subnet list model Header for VLSM Solver
+ * Copyright (C) 2011 Nelson Ka Hei Chan <khcha.n.el@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ********************************************************/
+
+#ifndef SUBNET_MODEL_H
+#define SUBNET_MODEL_H
+
+#include <gtk/gtk.h>
+#include "vlsm.h"
+
+/**
+ * enum for subnet_tree
+ */
+enum
+{
+  COL_NAME = 0,
+  COL_ADDR,
+  //COL_SMASK,
+  COL_DMASK,
+  COL_FHOST,
+  COL_LHOST,
+  COL_BCAST,
+  NUM_COLS
+};
+
+#define SUBNET_TYPE_MODEL     (subnet_model_get_type ())
+#define SUBNET_MODEL(obj)     (G_TYPE_CHECK_INSTANCE_CAST ((obj), SUBNET_TYPE_MODEL, SubnetModel))
+
+/**
+ * A list GtkTreeModel over an array of subnets and their host numbers,
+ * with the NUM_COLS string columns above. Nothing is formatted until the
+ * view asks for a cell, and then only that cell, so a plan costs the
+ * view its network_t records and nothing more. Subnets of 0 host are
+ * hidden, as subnet_tree always did.
+ */
+typedef struct subnet_model
+{
+  GObject parent;
+
+  const network_t *subnets; // not owned, see subnet_model_set()
+  const unsigned long *nhosts;
+  int *rows; // index into subnets of every row, NULL if row i is subnet i
+  int n; // rows
+  gint stamp; // changed by every subnet_model_set(), so old iters are caught
+} SubnetModel;
+
+typedef struct subnet_model_class
+{
+  GObjectClass parent_class;
+} SubnetModelClass;
+
+GType subnet_model_get_type (void);
+
+/**
+ * This function makes an empty model
+ */
+SubnetModel* subnet_model_new (void);
+
+/**
+ * Show the @n subnets in @subnets named after @nhosts, or nothing if @n
+ * is 0. The arrays are not copied and must stay until the next call.
+ * No row signal is sent: take the model off its views meanwhile, they
+ * ask for what they show again when it is set back.
+ * Return: 0 if Successful, -3 out of memory
+ */
+int subnet_model_set (SubnetModel *model,
+                      const network_t *subnets,
+                      const unsigned long *nhosts,
+                      int n);
+
+#endif
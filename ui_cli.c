@@ -20,7 +20,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include "vlsm.h"
+#include "batch.h"
+#include "plan.h"
+#include "lpm.h"
+#include "stats.h"
 
 
 static void
@@ -30,55 +35,635 @@ usage (char * argv0)
   printf("Usage: %s [ base_network base_netmask [numbers...] ]\n",argv0);
   printf("EX: %s 218.20.30.0 22  477 40 10 2\n",argv0);
   printf("If no parameter given, will run in interactive mode.\n");
+  printf("numbers: hosts of each subnet, by commas or blanks; CxH is C subnets of H hosts\n");
+  printf("       %s --binary[=5|=8] file base_network base_netmask [numbers...]\n",argv0);
+  printf("Write the subnets to file as 5 (default) or 8 byte binary records\n");
+  printf("       %s --batch [-j threads] [file]\n",argv0);
+  printf("Solve one job per line of file (or stdin): base_network/base_netmask [numbers...]\n");
+  printf("       %s --multi net/mask[,net/mask...]|@file [numbers...]\n",argv0);
+  printf("Pack the subnets into several base networks, listed in the argument or in file\n");
+  printf("       %s --summarize [files...]\n",argv0);
+  printf("Print the fewest prefixes covering the subnets of the plans (text or binary) or stdin\n");
+  printf("       %s --stats[=trace.json] [any of the above]\n",argv0);
+  printf("Print time per phase and heap use to stderr, and a Chrome trace (needs make STATS=1)\n");
+  printf("       %s --conflicts plan [plans...]\n",argv0);
+  printf("Report every pair of overlapping subnets in the plans (text or binary), exit 4 if any\n");
+  printf("       %s --lookup plan [file]\n",argv0);
+  printf("Annotate every address in file (or stdin) with the index and subnet of plan holding it\n");
 }
 
 
+/* solve every job in the given file or stdin: --batch [-j N] [file] */
 static int
-normal_intf (int argc, char ** argv)
+batch_intf (int argc, char ** argv)
 {
-  /* initialize */
-  int i;
-  ipv4str_t ipstr;
-  network_t * subnets;
-  int vlsm_code=0;
-  int num_subnets = argc - 3 ;
+  FILE * in = stdin;
+  int    ret,
+         i = 2,
+         nthreads = 1;
 
+  if (argc > i + 1 && strcmp(argv[i],"-j") == 0) {
+    char * end;
+    long   j = strtol(argv[i+1],&end,10);
+    if (end == argv[i+1] || *end != '\0' || j < 1) {
+      printf("#Error: invalid number of threads %s\n",argv[i+1]);
+      return 3;
+    }
+    /* more threads than that only add memory and contention */
+    nthreads = (j > BATCH_MAX_THREADS) ? BATCH_MAX_THREADS : (int)j;
+    i += 2;
+  }
+  if (argc > i && strcmp(argv[i],"-") != 0) {
+    in = fopen(argv[i],"r");
+    if (in == NULL) {
+      printf("#Error: cannot open %s\n",argv[i]);
+      return 3;
+    }
+  }
+  ret = batch_run(in,stdout,nthreads);
+  if (in != stdin) fclose(in);
+  return ret;
+}
 
-  /* init given_net */
-  network_t given_net;
-  strtoipv4(given_net.addr,argv[1]);
-  given_net.mask = (unsigned char) atoi (argv[2]);
-  makenetwork(&given_net,given_net.addr,given_net.mask);
 
-  /* init nhosts array */
-  unsigned long n_arr[num_subnets];
-  for (i=0;i<num_subnets;i++) {
-    n_arr[i] = (unsigned long) atol (argv[i+3]);
+/**
+ * append the base networks "a.b.c.d/m" separated by commas or blanks in
+ * @s to @pools. RETURN 0 if Successful, -1 if one is invalid, -3 memory
+ */
+static int
+parse_pools (network_t ** pools, int * npools, int * cap, const char * s)
+{
+  for (;;) {
+    ipv4u32_t       addr;
+    ipv4_t          a;
+    unsigned char   err;
+    size_t          used;
+    char          * end;
+    unsigned long   mask;
+    const char    * slash;
+
+    while (*s == ',' || *s == ' ' || *s == '\t' || *s == '\n' || *s == '\r') s++;
+    if (*s == '\0') return 0;
+    slash = strchr(s,'/');
+    if (slash == NULL
+     || ipv4parse(&addr, &err, 1, s, (size_t)(slash - s), &used) != 1
+     || err != IPV4_PARSE_OK || used != (size_t)(slash - s))
+    {
+      return -1;
+    }
+    mask = strtoul(slash + 1, &end, 10);
+    if (end == slash + 1 || mask > IPV4_BITLEN) return -1;
+    s = end;
+    if (*s != '\0' && *s != ',' && *s != ' ' && *s != '\t' && *s != '\n' && *s != '\r') return -1;
+
+    if (*npools == *cap) {
+      network_t * p = (network_t *) realloc (*pools, sizeof(network_t) * (*cap ? *cap * 2 : 16));
+      if (p == NULL) return -3;
+      *pools = p;
+      *cap = *cap ? *cap * 2 : 16;
+    }
+    u32toipv4(a, addr);
+    makenetwork(&(*pools)[(*npools)++], a, (unsigned char)mask);
+  }
+}
+
+
+/**
+ * vlsm_parse_hosts() over the @argc arguments @argv, storing the first
+ * @cap numbers in @nhosts. RETURN the number of host numbers, or the
+ * exit code negated after printing the error
+ */
+static int
+parse_hosts_argv (unsigned long * nhosts, int cap, int argc, char ** argv)
+{
+  int     i,
+          ret,
+          n = 0;
+  size_t  pos = 0;
+
+  for (i=0;i<argc;i++) {
+    ret = vlsm_parse_hosts((n < cap) ? nhosts + n : nhosts, (n < cap) ? cap - n : 0,
+                           argv[i], strlen(argv[i]), &pos);
+    if (ret > INT_MAX - n) {
+      ret = -2;
+      pos = 0;
+    }
+    if (ret == -1) {
+      printf("#Error: invalid number of hosts at character %lu of \"%s\"\n",(unsigned long)pos + 1,argv[i]);
+      return -1;
+    } else if (ret < 0) {
+      printf("#Error: too many hosts at character %lu of \"%s\"\n",(unsigned long)pos + 1,argv[i]);
+      return -2;
+    }
+    n += ret;
+  }
+  return n;
+}
+
+
+/**
+ * read a whole line of @in into *@line, which has *@cap bytes and grows
+ * as needed. RETURN 1 if a line was read, 0 at end of file, -3 memory
+ */
+static int
+read_line (FILE * in, char ** line, size_t * cap)
+{
+  size_t len = 0;
+
+  for (;;) {
+    size_t room;
+    if (*cap - len < 2) {
+      size_t  c = *cap ? *cap * 2 : 256;
+      char  * p = (char *) realloc (*line, c);
+      if (p == NULL) return -3;
+      *line = p;
+      *cap = c;
+    }
+    room = *cap - len;
+    if (room > INT_MAX) room = INT_MAX;
+    if (fgets(*line + len,(int)room,in) == NULL) return len > 0;
+    len += strlen(*line + len);
+    if (len > 0 && (*line)[len-1] == '\n') return 1;
   }
+}
+
+
+/* pack the subnets into several base networks: --multi pools [numbers...] */
+static int
+multi_intf (int argc, char ** argv)
+{
+  network_t     * pools = NULL,
+                * subnets;
+  int           * pool_of;
+  unsigned long * n_arr;
+  int             npools = 0,
+                  cap = 0,
+                  num_subnets,
+                  vlsm_code,
+                  i;
 
+  /* base networks */
+  if (argv[2][0] == '@') {
+    FILE  * in = fopen(argv[2] + 1,"r");
+    char  * line = NULL;
+    size_t  linecap = 0;
+    int     ret = 0;
+    if (in == NULL) {
+      printf("#Error: cannot open %s\n",argv[2] + 1);
+      return 3;
+    }
+    while (ret == 0 && (ret = read_line(in,&line,&linecap)) > 0) {
+      ret = parse_pools(&pools,&npools,&cap,line);
+    }
+    fclose(in);
+    free(line);
+    i = ret;
+  } else {
+    i = parse_pools(&pools,&npools,&cap,argv[2]);
+  }
+  if (i == -3) {
+    printf("#Error: memory error\n");
+    free(pools);
+    return 3;
+  } else if (i != 0 || npools == 0) {
+    printf("#Error: invalid base network\n");
+    free(pools);
+    return 1;
+  }
+  num_subnets = parse_hosts_argv(NULL,0,argc - 3,argv + 3);
+  if (num_subnets < 0) {
+    free(pools);
+    return -num_subnets;
+  }
 
   /* print desciption */
-  ipv4tostr(ipstr,given_net.addr);
-  printf("## Given network: %s/%d\n",ipstr,given_net.mask);
-  printf("## %d subnets to address\n",num_subnets);
+  printf("## Given networks:");
+  for (i=0;i<npools;i++) {
+    ipv4str_t ipstr;
+    ipv4tostr(ipstr,pools[i].addr);
+    printf(" %s/%d",ipstr,pools[i].mask);
+  }
+  printf("\n## %d subnets to address\n",num_subnets);
   printf("## Format: net_addr/smask (dmask)|first_host|last_host|broadcast [usable]\n");
 
-  /* allocate memory for subnets */
-  subnets = (network_t *) malloc (sizeof(network_t) * num_subnets);
-  if (subnets == NULL) {
+  /* allocate memory */
+  subnets = (network_t *) malloc (sizeof(network_t) * (num_subnets + 1));
+  pool_of = (int *) malloc (sizeof(int) * (num_subnets + 1));
+  n_arr = (unsigned long *) malloc (sizeof(unsigned long) * (num_subnets + 1));
+  if (subnets == NULL || pool_of == NULL || n_arr == NULL) {
+    vlsm_code = -3;
+  } else {
+    parse_hosts_argv(n_arr,num_subnets,argc - 3,argv + 3);
+    vlsm_code = vlsm_multi(subnets,pool_of,pools,npools,n_arr,num_subnets);
+  }
+
+  /* output */
+  if (vlsm_code >= 0) {
+    print_plan_pools(stdout,subnets,pool_of,pools,n_arr,num_subnets);
+  } else if (vlsm_code == -1) {
+    printf("#Error: invalid net mask or overlapping base networks\n");
+  } else if (vlsm_code == -2) {
+    printf("#Error: too many or no host to address for the given networks\n");
+  } else {
+    printf("#Error: memory error\n");
+  }
+  free(pools);
+  free(subnets);
+  free(pool_of);
+  free(n_arr);
+  return (vlsm_code >= 0) ? 0 : -vlsm_code;
+}
+
+
+/* print the error @ret of plan_read() on @name, RETURN the exit code */
+static int
+plan_error (int ret, const char * name)
+{
+  if (ret == -1) printf("#Error: cannot read %s\n",name);
+  else if (ret == -2) printf("#Error: %s is not a plan\n",name);
+  else printf("#Error: memory error\n");
+  return (ret == -2) ? 1 : 3;
+}
+
+
+/**
+ * read the subnets of the plans in argv[@first...], or stdin if there is
+ * none, into @*subnets, dropping those of 0 host.
+ * RETURN 0 if Successful, or the exit code after printing the error
+ */
+static int
+read_plans (int argc, char ** argv, int first, network_t ** subnets, int * count)
+{
+  network_t * all = NULL;
+  int         n = 0,
+              i = first;
+
+  do {
+    network_t * s;
+    network_t * p;
+    uint64_t    k,
+                m;
+    int         ret = plan_read(i < argc ? argv[i] : NULL,&s,&m);
+
+    if (ret == 0 && m > (uint64_t)(INT_MAX - n)) {
+      free(s);
+      ret = -3;
+    }
+    if (ret == 0) {
+      p = (network_t *) realloc (all, sizeof(network_t) * ((size_t)n + m + 1));
+      if (p == NULL) {
+        free(s);
+        ret = -3;
+      } else {
+        all = p;
+      }
+    }
+    if (ret != 0) {
+      free(all);
+      return plan_error(ret,(i < argc) ? argv[i] : "stdin");
+    }
+    for (k=0;k<m;k++) {
+      if (s[k].mask != 0) all[n++] = s[k];
+    }
+    free(s);
+  } while (++i < argc);
+
+  *subnets = all;
+  *count = n;
+  return 0;
+}
+
+
+/* print the fewest prefixes covering the given plans: --summarize [files...] */
+static int
+summarize_intf (int argc, char ** argv)
+{
+  network_t * subnets = NULL;
+  int         n = 0,
+              m,
+              ret = read_plans(argc,argv,2,&subnets,&n);
+
+  if (ret != 0) return ret;
+  m = vlsm_summarize(subnets,n);
+  if (m < 0) {
+    printf("#Error: memory error\n");
+    free(subnets);
+    return 3;
+  }
+  printf("## %d subnets summarized to %d prefixes\n",n,m);
+  print_prefixes(stdout,subnets,m);
+  free(subnets);
+  return 0;
+}
+
+
+/* the plans of conflicts_intf(), every subnet with its plan and record */
+typedef struct
+{
+  network_t     * subnets;
+  int           * plan_of,
+                * rec_of;
+  char         ** names;
+} plans_t;
+
+
+static void
+print_conflict (void * data, int a, int b)
+{
+  const plans_t * pl = (const plans_t *)data;
+  char            sa[24],
+                  sb[24];
+
+  sa[fmt_prefix(sa,&pl->subnets[a])] = '\0';
+  sb[fmt_prefix(sb,&pl->subnets[b])] = '\0';
+  printf("%s:%d %s overlaps %s:%d %s\n",
+         pl->names[pl->plan_of[a]],pl->rec_of[a],sa,
+         pl->names[pl->plan_of[b]],pl->rec_of[b],sb);
+}
+
+
+/**
+ * report every pair of overlapping subnets in the plans: --conflicts files...
+ * as "plan:record subnet overlaps plan:record subnet". Records are the
+ * subnets of a plan counted from 0, requirements of 0 host left out as
+ * print_plan() does, so a text and a binary plan of one solve agree
+ */
+static int
+conflicts_intf (int argc, char ** argv)
+{
+  plans_t   pl;
+  int       n = 0,
+            i;
+  long      count;
+
+  memset(&pl,0,sizeof(pl));
+  pl.names = argv;
+  for (i=2;i<argc;i++) {
+    network_t * s;
+    uint64_t    m,
+                k;
+    int         ret = plan_read(argv[i],&s,&m),
+                rec = 0;
+
+    if (ret == 0 && m > (uint64_t)(INT_MAX - n)) ret = -3;
+    if (ret == 0) {
+      size_t      total = (size_t)n + m + 1;
+      network_t * ps = (network_t *) realloc (pl.subnets, sizeof(network_t) * total);
+      int       * pp,
+                * pr;
+      if (ps != NULL) pl.subnets = ps;
+      pp = (int *) realloc (pl.plan_of, sizeof(int) * total);
+      if (pp != NULL) pl.plan_of = pp;
+      pr = (int *) realloc (pl.rec_of, sizeof(int) * total);
+      if (pr != NULL) pl.rec_of = pr;
+      if (ps == NULL || pp == NULL || pr == NULL) ret = -3;
+    }
+    if (ret != 0) {
+      free(s);
+      free(pl.subnets);
+      free(pl.plan_of);
+      free(pl.rec_of);
+      return plan_error(ret,argv[i]);
+    }
+    for (k=0;k<m;k++) {
+      if (s[k].mask == 0) continue;
+      pl.subnets[n] = s[k];
+      pl.plan_of[n] = i;
+      pl.rec_of[n++] = rec++;
+    }
+    free(s);
+  }
+
+  count = vlsm_overlaps(pl.subnets,n,print_conflict,&pl);
+  free(pl.subnets);
+  free(pl.plan_of);
+  free(pl.rec_of);
+  if (count < 0) {
+    printf("#Error: memory error\n");
+    return 3;
+  }
+  printf("## %d subnets in %d plans, %ld overlapping pairs\n",n,argc - 2,count);
+  return count ? 4 : 0;
+}
+
+
+#define LOOKUP_BATCH    1024
+
+/* is @c between two addresses of ipv4parse() */
+static int
+is_sep (char c)
+{
+  return c == '\n' || c == '\r' || c == ' ' || c == '\t' || c == ',';
+}
+
+
+/**
+ * annotate addresses with the plan subnet holding them: --lookup plan [file]
+ * "addr index subnet" per address, "addr -" if none holds it. The index
+ * counts subnets only, as the records of --conflicts do
+ */
+static int
+lookup_intf (int argc, char ** argv)
+{
+  static char     buf[64 * 1024],
+                  out[LOOKUP_BATCH * 64];
+  ipv4u32_t       addrs[LOOKUP_BATCH];
+  unsigned char   errs[LOOKUP_BATCH];
+  int             idx[LOOKUP_BATCH];
+  network_t     * subnets;
+  uint64_t        count,
+                  i,
+                  m = 0;
+  lpm_t         * lpm;
+  FILE          * in = stdin;
+  size_t          len = 0;
+  long            invalid = 0;
+  int             eof = 0,
+                  ret;
+
+  ret = plan_read(argv[2],&subnets,&count);
+  if (ret == 0 && count > LPM_MAXN) {
+    free(subnets);
+    ret = -3;
+  }
+  if (ret != 0) return plan_error(ret,argv[2]);
+  /* requirements of 0 host are only in binary plans, leave them out */
+  for (i=0;i<count;i++) {
+    if (subnets[i].mask != 0) subnets[m++] = subnets[i];
+  }
+  count = m;
+  lpm = lpm_new(subnets,(int)count);
+  if (lpm == NULL) {
     printf("#Error: memory error\n");
+    free(subnets);
     return 3;
   }
+  if (argc > 3 && strcmp(argv[3],"-") != 0) {
+    in = fopen(argv[3],"r");
+    if (in == NULL) {
+      printf("#Error: cannot open %s\n",argv[3]);
+      lpm_free(lpm);
+      free(subnets);
+      return 3;
+    }
+  }
+
+  while (!eof || len > 0) {
+    size_t  cut,
+            pos = 0;
+
+    if (!eof) {
+      size_t got = fread(buf + len, 1, sizeof(buf) - len, in);
+      eof = (got == 0);
+      len += got;
+    }
+    /* parse up to the last separator only, the rest may go on */
+    cut = len;
+    if (!eof) {
+      while (cut > 0 && !is_sep(buf[cut-1])) cut--;
+      if (cut == 0 && len < sizeof(buf)) continue;
+      if (cut == 0) cut = len;
+    }
+
+    while (pos < cut) {
+      size_t  used,
+              n = ipv4parse(addrs,errs,LOOKUP_BATCH,buf + pos,cut - pos,&used),
+              k;
+      char  * p = out;
+
+      lpm_lookup_batch(lpm,addrs,idx,n);
+      for (k=0;k<n;k++) {
+        if (errs[k] != IPV4_PARSE_OK) {
+          static const char bad[] = "#Error: invalid address\n";
+          memcpy(p,bad,sizeof(bad) - 1);
+          p += sizeof(bad) - 1;
+          invalid++;
+          continue;
+        }
+        p += ipv4fmt(p,addrs[k]);
+        *p++ = ' ';
+        if (idx[k] < 0) {
+          *p++ = '-';
+        } else {
+          p += sprintf(p,"%d ",idx[k]);
+          p += fmt_prefix(p,&subnets[idx[k]]);
+        }
+        *p++ = '\n';
+      }
+      fwrite(out,1,(size_t)(p - out),stdout);
+      pos += used;
+      if (n == 0) break;
+    }
+    memmove(buf,buf + cut,len - cut);
+    len -= cut;
+  }
+
+  if (in != stdin) fclose(in);
+  lpm_free(lpm);
+  free(subnets);
+  if (invalid) {
+    printf("#Error: %ld invalid addresses\n",invalid);
+    return 1;
+  }
+  return 0;
+}
+
+
+/**
+ * print the space of @base left by the @n @subnets as "## Free" lines.
+ * RETURN 0 if Successful, -3 out of memory
+ */
+static int
+print_free (const network_t * base, const network_t * subnets, int n)
+{
+  network_t     * blocks;
+  uint64_t        total;
+  unsigned char   largest;
+  char            line[32];
+  int             count = vlsm_free_space(&blocks,&total,&largest,base,subnets,n),
+                  i;
+
+  if (count < 0) return count;
+  if (count == 0) {
+    printf("## Free space: none\n");
+  } else {
+    printf("## Free space: %llu addresses in %d blocks, largest /%d\n",
+           (unsigned long long)total,count,largest);
+  }
+  for (i=0;i<count;i++) {
+    line[fmt_prefix(line,&blocks[i])] = '\0';
+    printf("## Free %s\n",line);
+  }
+  free(blocks);
+  return 0;
+}
+
+
+/* requirements a workspace holds on the stack, before any malloc */
+#define WS_STACK_REQS   256
+
+/**
+ * make @ws hold at least @n requirements, keeping the first @keep. @*mem
+ * is the heap block behind @ws, NULL while it is still on the stack.
+ * Grows by doubling, RETURN 0 if out of memory
+ */
+static int
+ws_reserve (vlsm_ws_t * ws, void ** mem, int n, int keep)
+{
+  int     cap = ws->cap ? ws->cap : 1;
+  void  * p;
+
+  if (n <= ws->cap) return 1;
+  while (cap < n) cap = (cap > INT_MAX / 2) ? INT_MAX : cap * 2;
+  STATS_MALLOC(vlsm_ws_size(cap));
+  p = (*mem == NULL) ? malloc (vlsm_ws_size(cap)) : realloc (*mem, vlsm_ws_size(cap));
+  if (p == NULL) return 0;
+  if (*mem == NULL) memcpy(p, ws->nhosts, sizeof(unsigned long) * keep);
+  *mem = p;
+  vlsm_ws_init(ws, p, vlsm_ws_size(cap));
+  return 1;
+}
+
+
+/**
+ * solve the @n requirements in @ws over @given_net, print it or, if
+ * @binfile is not NULL, write it to @binfile as a binary result file of
+ * @recsize records
+ */
+static int
+solve_intf (const network_t * given_net, vlsm_ws_t * ws, int n,
+            const char * binfile, unsigned int recsize)
+{
+  ipv4str_t ipstr;
+  int vlsm_code;
+
+  /* print desciption */
+  ipv4tostr(ipstr,given_net->addr);
+  printf("## Given network: %s/%d\n",ipstr,given_net->mask);
+  printf("## %d subnets to address\n",n);
+  printf("## Format: net_addr/smask (dmask)|first_host|last_host|broadcast [usable]\n");
 
   /* VLSM */
-  vlsm_code = vlsm(subnets,given_net.addr,given_net.mask,n_arr,num_subnets);
+  vlsm_code = vlsm_ws_solve(ws,given_net,n);
 
   /* output */
-  if (vlsm_code >= 0) {
-    for (i=0;i<num_subnets;i++) {
-      if (n_arr[i] == 0 ) continue; /* due to invalid user input */
-      printf("# Subnet %ld :\n",n_arr[i]);
-      print_network(&subnets[i]);
+  if (vlsm_code >= 0 && binfile != NULL) {
+    FILE * out = fopen(binfile,"wb");
+    if (out == NULL || plan_write(out,given_net,ws->subnets,n,recsize) != 0) {
+      printf("#Error: cannot write %s\n",binfile);
+      if (out != NULL) fclose(out);
+      return 3;
+    }
+    if (fclose(out) != 0) {
+      printf("#Error: cannot write %s\n",binfile);
+      return 3;
+    }
+    printf("## %d records written to %s\n",n,binfile);
+  } else if (vlsm_code >= 0) {
+    print_plan(stdout,ws->subnets,ws->nhosts,n);
+    if (print_free(given_net,ws->subnets,n) != 0) {
+      printf("#Error: memory error\n");
+      return 3;
     }
   } else if (vlsm_code == -1) {
     printf("#Error: invalid net mask\n");
@@ -86,97 +671,159 @@ normal_intf (int argc, char ** argv)
   } else if (vlsm_code == -2) {
     printf("#Error: too many or no host to address for the given network\n");
     return 2;
+  } else {
+    printf("#Error: memory error\n");
+    return 3;
   }
 
   return 0;
 }
 
 
-/* as a wrapper to normal_intf */
+/**
+ * solve the problem in argv, print it or, if @binfile is not NULL,
+ * write it to @binfile as a binary result file of @recsize records
+ */
+static int
+normal_intf (int argc, char ** argv, const char * binfile, unsigned int recsize)
+{
+  unsigned long stackmem[WS_STACK_REQS + (WS_STACK_REQS * sizeof(network_t)) / sizeof(unsigned long) + 1];
+  void * mem = NULL;
+  vlsm_ws_t ws;
+  network_t given_net;
+  int num_subnets;
+  int ret;
+  STATS_BEGIN(t_job);
+  STATS_BEGIN(t_parse);
+
+  /* init given_net */
+  strtoipv4(given_net.addr,argv[1]);
+  given_net.mask = (unsigned char) atoi (argv[2]);
+  makenetwork(&given_net,given_net.addr,given_net.mask);
+  ipv4tonet(given_net.addr,given_net.addr,given_net.mask); /* the base vlsm() uses */
+
+  /* init nhosts array, parsed again if it did not fit */
+  vlsm_ws_init(&ws,stackmem,sizeof(stackmem));
+  num_subnets = parse_hosts_argv(ws.nhosts,ws.cap,argc - 3,argv + 3);
+  if (num_subnets < 0) return -num_subnets;
+  if (num_subnets > ws.cap) {
+    if (!ws_reserve(&ws,&mem,num_subnets,0)) {
+      printf("#Error: memory error\n");
+      return 3;
+    }
+    parse_hosts_argv(ws.nhosts,ws.cap,argc - 3,argv + 3);
+  }
+  STATS_END(STATS_PARSE, t_parse);
+
+  ret = solve_intf(&given_net,&ws,num_subnets,binfile,recsize);
+  free(mem);
+  if (ret == 0) STATS_JOB(t_job);
+  return ret;
+}
+
+
+/* ask for one problem after another and solve it as normal_intf does */
 static int interactive_intf (const char * argv0)
 {
-  /* main */
-  int i;
+  unsigned long stackmem[WS_STACK_REQS + (WS_STACK_REQS * sizeof(network_t)) / sizeof(unsigned long) + 1];
+  void * mem = NULL;
+  vlsm_ws_t ws;
   int run=1;
+
+  vlsm_ws_init(&ws,stackmem,sizeof(stackmem));
   while (run) {
     /* init */
-    char  tmpstr[32];
-    char ** new_argv;
-    new_argv = (char **)malloc(sizeof(char *));
-    new_argv[0] = (char *) malloc (sizeof (char) * strlen(argv0) +1);
-    int new_argc=1;
-    strcpy(new_argv[0],argv0);
+    char  tmpstr[32],
+        * tmpstr_p = tmpstr;
+    network_t given_net;
+    int n = 0;
     printf("VLSM Solver %s --- by Nelson Chan\n",VLSM_VERSION);
-    printf("Interactive mode\n** see %s --help\n\n",new_argv[0]);
+    printf("Interactive mode\n** see %s --help\n\n",argv0);
 
     /* input net addr */
     printf("Enter the base network's address: ");
-    scanf("%s",tmpstr);
-    new_argc += 1;
-    new_argv = (char **) realloc (new_argv, sizeof(char *) * new_argc );
-    new_argv[new_argc-1] = (char *) malloc (sizeof(char) * strlen(tmpstr) + 1);
-    strcpy (new_argv[new_argc-1] , tmpstr);
-    printf ("addr:%s\n",new_argv[new_argc-1]);
+    if (scanf("%31s",tmpstr) != 1) break;
+    printf ("addr:%s\n",tmpstr);
+    strtoipv4(given_net.addr,tmpstr);
 
     /* input mask */
     printf("Enter the base network's mask: ");
-    scanf("%s",tmpstr);
-    new_argc += 1;
-    new_argv = (char **) realloc (new_argv, sizeof(char *) * new_argc );
-    new_argv[new_argc-1] = (char *) malloc (sizeof(char) * strlen(tmpstr) + 1);
-    strcpy (new_argv[new_argc-1] , tmpstr);
-    printf("mask:%s\n",new_argv[new_argc-1]);
-
-    /* input subnets host num */
-    printf("Enter the no. of hosts in each subnets, enter 0 to end:\n");
-    scanf("%s",tmpstr);
-    while (strcmp(tmpstr,"0") != 0) {
-      new_argc += 1;
-      new_argv = (char **) realloc (new_argv, sizeof(char *) * new_argc );
-      new_argv[new_argc-1] = (char *) malloc (sizeof(char) * strlen(tmpstr)+ 1);
-      strcpy (new_argv[new_argc-1] , tmpstr);
+    if (scanf("%31s",tmpstr) != 1) break;
+    printf("mask:%s\n",tmpstr);
+    makenetwork(&given_net,given_net.addr,(unsigned char) atoi (tmpstr));
+    ipv4tonet(given_net.addr,given_net.addr,given_net.mask);
 
-      scanf("%s",tmpstr);
-    }
-
-    /* verbose */
-    printf("@ new_argc = %d\n",new_argc);
-    for (i=0;i<new_argc;i++) {
-      printf("@ %s\n",new_argv[i]);
+    /* input subnets host num, straight into the workspace */
+    printf("Enter the no. of hosts in each subnets, enter 0 to end:\n");
+    while (scanf("%31s",tmpstr) == 1 && strcmp(tmpstr,"0") != 0) {
+      int more = parse_hosts_argv(NULL,0,1,&tmpstr_p);
+      if (more < 0 || more > INT_MAX - n) continue; // skip it
+      if (!ws_reserve(&ws,&mem,n + more,n)) {
+        printf("#Error: memory error\n");
+        free(mem);
+        return 3;
+      }
+      n += parse_hosts_argv(ws.nhosts + n,more,1,&tmpstr_p);
     }
 
-    /* call normal_intf */
+    /* solve */
     printf("\n\n");
-    normal_intf(new_argc,new_argv);
-
-    /* free new_argv... */
-    for (i=0;i<new_argc;i++) {
-      free(new_argv[i]);
-    }
-    free(new_argv);
+    solve_intf(&given_net,&ws,n,NULL,0);
 
     /* finish */
     printf("\nAgain? (yes/NO) ");
-    scanf("%s",tmpstr);
-
-    if (strncmp(tmpstr,"yes",3) == 0 ) {
+    if (scanf("%31s",tmpstr) == 1 && strncmp(tmpstr,"yes",3) == 0 ) {
       printf("\n\n");
     } else {
       run = 0;
     }
   }
 
+  free(mem);
   return 0;
 }
 
 
-int main (int argc, char ** argv)
+/* run the mode chosen by argv */
+static int
+run_intf (int argc, char ** argv)
 {
   /* init */
   int intf=0; /* 0 for normal mode, 1 for interactive */
 
   /* check args */
-  if (argc == 1) {
+  if (argc > 1 && strcmp(argv[1],"--batch") == 0) {
+    return batch_intf(argc,argv);
+  } else if (argc > 2 && strcmp(argv[1],"--conflicts") == 0) {
+    return conflicts_intf(argc,argv);
+  } else if (argc > 2 && strcmp(argv[1],"--lookup") == 0) {
+    return lookup_intf(argc,argv);
+  } else if (argc > 1 && strcmp(argv[1],"--summarize") == 0) {
+    return summarize_intf(argc,argv);
+  } else if (argc > 1 && strcmp(argv[1],"--multi") == 0) {
+    if (argc < 3) {
+      usage(argv[0]);
+      return 0;
+    }
+    return multi_intf(argc,argv);
+  } else if (argc > 1 && strncmp(argv[1],"--binary",8) == 0) {
+    unsigned int recsize = PLAN_REC5;
+    if (strcmp(argv[1],"--binary=8") == 0) {
+      recsize = PLAN_REC8;
+    } else if (strcmp(argv[1],"--binary") != 0 && strcmp(argv[1],"--binary=5") != 0) {
+      usage(argv[0]);
+      return 0;
+    }
+    if (argc < 5) {
+      usage(argv[0]);
+      return 0;
+    }
+    {
+      const char * binfile = argv[2];
+      argv[2] = argv[0];  /* drop "--binary file", keep argv[0] */
+      return normal_intf(argc-2,argv+2,binfile,recsize);
+    }
+  } else if (argc == 1) {
     intf = 1;
   }  else if ( argc < 3 ) {
     usage(argv[0]);
@@ -184,5 +831,39 @@ int main (int argc, char ** argv)
   }
 
   /* main */
-  return (intf == 0)?normal_intf(argc,argv):interactive_intf(argv[0]);
+  return (intf == 0)?normal_intf(argc,argv,NULL,0):interactive_intf(argv[0]);
+}
+
+
+int main (int argc, char ** argv)
+{
+  const char * trace = NULL;
+  int          stats = 0,
+               ret;
+
+  /* --stats[=trace.json] goes before the mode */
+  if (argc > 1 && strncmp(argv[1],"--stats",7) == 0
+   && (argv[1][7] == '\0' || argv[1][7] == '='))
+  {
+    if (argv[1][7] == '=') trace = argv[1] + 8;
+    ret = stats_enable(trace);
+    if (ret == -1) {
+      printf("#Error: built without stats, rebuild with make STATS=1\n");
+      return 1;
+    } else if (ret != 0) {
+      printf("#Error: memory error\n");
+      return 3;
+    }
+    argv[1] = argv[0];
+    argv++;
+    argc--;
+    stats = 1;
+  }
+
+  ret = run_intf(argc,argv);
+  if (stats && stats_report(stderr) != 0) {
+    fprintf(stderr,"#Error: cannot write %s\n",trace);
+    if (ret == 0) ret = 3;
+  }
+  return ret;
 }
@@ -18,13 +18,20 @@
 
 #include <stdio.h>
 #include <gtk/gtk.h>
+#include <string.h>
 #include "gtk_main_window.h"
+#include "stats.h"
 
 
 int main (int argc, char ** argv)
 {
   gtk_init(&argc, &argv);
 
+  /* --stats: show the numbers of every solve in the status bar */
+  if (argc > 1 && strcmp(argv[1], "--stats") == 0 && stats_enable(NULL) != 0) {
+    printf("# built without stats, rebuild with make STATS=1\n");
+  }
+
   MainWindow *win = mw_new();
   mw_show(win);
   printf("# Entering GTK main loop... \n");
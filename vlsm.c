@@ -20,82 +20,523 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-#include <math.h>
+#include <limits.h>
 #include "vlsm.h"
+#include "stats.h"
+
+
+/**
+ * per-prefix lookup table, built by the compiler
+ * PREFIX_ENTRY(p) expands to the constant initializer of prefix /p
+ */
+#define PREFIX_MASK(p)    ((ipv4u32_t)(0xffffffffULL << (IPV4_BITLEN - (p))))
+#define PREFIX_AHOSTS(p)  ((uint64_t)1 << (IPV4_BITLEN - (p)))
+#define PREFIX_ENTRY(p)                                                   \
+  { PREFIX_MASK(p),                                                       \
+    (ipv4u32_t)~PREFIX_MASK(p),                                           \
+    { (unsigned char)(PREFIX_MASK(p) >> 24),                              \
+      (unsigned char)(PREFIX_MASK(p) >> 16),                              \
+      (unsigned char)(PREFIX_MASK(p) >> 8),                               \
+      (unsigned char)(PREFIX_MASK(p)) },                                  \
+    PREFIX_AHOSTS(p),                                                     \
+    ((p) < IPV4_BITLEN - 1) ? PREFIX_AHOSTS(p) - 2 : 0 }
+
+const prefix_t prefix_table[IPV4_BITLEN + 1] =
+{
+  PREFIX_ENTRY(0),  PREFIX_ENTRY(1),  PREFIX_ENTRY(2),  PREFIX_ENTRY(3),
+  PREFIX_ENTRY(4),  PREFIX_ENTRY(5),  PREFIX_ENTRY(6),  PREFIX_ENTRY(7),
+  PREFIX_ENTRY(8),  PREFIX_ENTRY(9),  PREFIX_ENTRY(10), PREFIX_ENTRY(11),
+  PREFIX_ENTRY(12), PREFIX_ENTRY(13), PREFIX_ENTRY(14), PREFIX_ENTRY(15),
+  PREFIX_ENTRY(16), PREFIX_ENTRY(17), PREFIX_ENTRY(18), PREFIX_ENTRY(19),
+  PREFIX_ENTRY(20), PREFIX_ENTRY(21), PREFIX_ENTRY(22), PREFIX_ENTRY(23),
+  PREFIX_ENTRY(24), PREFIX_ENTRY(25), PREFIX_ENTRY(26), PREFIX_ENTRY(27),
+  PREFIX_ENTRY(28), PREFIX_ENTRY(29), PREFIX_ENTRY(30), PREFIX_ENTRY(31),
+  PREFIX_ENTRY(32)
+};
+
+
+/* count leading zeros of a non-zero 64-bit value */
+static int
+clz64 (uint64_t x)
+{
+#ifdef __GNUC__
+  return __builtin_clzll(x);
+#else
+  int n = 0;
+  while (!(x & ((uint64_t)1 << 63))) {
+    x <<= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+/* count trailing zeros of a non-zero 64-bit value */
+static int
+ctz64 (uint64_t x)
+{
+#ifdef __GNUC__
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while (!(x & 1)) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+static int parse_quad (const char *, const char *, int, ipv4u32_t *);
 
 void
 ipv4tostr (ipv4str_t      ipstr,
            const ipv4_t   addr)
 {
-  snprintf(ipstr,IPV4_STRLEN,"%d.%d.%d.%d",addr[0],addr[1],addr[2],addr[3]);
+  ipstr[ipv4fmt(ipstr,ipv4tou32(addr))] = '\0';
 }
 
 int
 strtoipv4 (ipv4_t           addr,
            const ipv4str_t  ipstr)
 {
-  int x,i;
-  char tmp_str[4];
-  sprintf(tmp_str,"%s","");
-  /* validate ipstr */
-  x=0;
-  for (i=0;i<=strlen(ipstr);i++) {
-    if (ipstr[i] == '.' || ipstr[i] == ',' || ipstr[i] == '\0') {
-      addr[x] = (unsigned char)atoi(tmp_str);
-      sprintf(tmp_str,"%s","");
-      x++;
-    } else if (isdigit(ipstr[i]) == 0) {
-      makeipv4(addr,0,0,0,0);
-      return 0;
+  ipv4u32_t x;
+  if (parse_quad(ipstr, ipstr + strlen(ipstr), 1, &x) != IPV4_PARSE_OK) {
+    makeipv4(addr,0,0,0,0);
+    return 0;
+  }
+  u32toipv4(addr,x);
+  return 1;
+}
+
+
+/**
+ * parse [s,e) as a dotted quad. When comma_is_dot is set ',' is accepted
+ * as octet separator as well (strtoipv4 has always done that)
+ * return one of IPV4_PARSE_*
+ */
+static int
+parse_quad (const char     * s,
+            const char     * e,
+            int              comma_is_dot,
+            ipv4u32_t      * addr)
+{
+  ipv4u32_t     x=0;
+  unsigned int  octet=0;
+  int           ndigits=0,
+                ndots=0,
+                bad_octets=0,
+                bad_range=0;
+
+  for (; s<e; s++) {
+    unsigned int d = (unsigned char)*s - '0';
+    if (d < 10) {
+      octet = octet*10 + d;
+      ndigits++;
+    } else if (*s == '.' || (comma_is_dot && *s == ',')) {
+      bad_octets |= (ndigits == 0 || ndots == 3);
+      bad_range  |= (ndigits > 3 || octet > 255);
+      x = x << 8 | (octet & 0xff);
+      octet = ndigits = 0;
+      ndots++;
     } else {
-      if (x == 4) return 0;  /* fail because we have > 3 dots */
-      sprintf(tmp_str,"%s%c",tmp_str,ipstr[i]);
-      if (strlen(tmp_str) > 3 ) {
-        makeipv4(addr,0,0,0,0);
-        return 0;
+      return IPV4_PARSE_ECHAR;
+    }
+  }
+  bad_octets |= (ndigits == 0 || ndots != 3);
+  bad_range  |= (ndigits > 3 || octet > 255);
+
+  if (bad_octets) return IPV4_PARSE_EOCTETS;
+  if (bad_range) return IPV4_PARSE_ERANGE;
+  *addr = x << 8 | octet;
+  return IPV4_PARSE_OK;
+}
+
+
+/* entry separators of ipv4parse() */
+static int
+is_parse_sep (char c)
+{
+  return c == '\n' || c == ',' || c == ' ' || c == '\t' || c == '\r';
+}
+
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_PARSE_SIMD 1
+#include <immintrin.h>
+
+/**
+ * SSSE3 version of parse_quad for the common case: a well formed entry
+ * which, together with its separator, fits in the 16 bytes at s.
+ * Caller guarantees 16 bytes are readable.
+ * return the length of the entry, or 0 if the caller has to fall back
+ * to parse_quad (anything unusual, including every kind of error)
+ */
+__attribute__((target("ssse3")))
+static int
+parse_quad_simd (const char * s,
+                 ipv4u32_t  * addr)
+{
+  __m128i       v = _mm_loadu_si128((const __m128i *)s);
+  __m128i       d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+  __m128i       isdig = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+  __m128i       isdot = _mm_cmpeq_epi8(v, _mm_set1_epi8('.'));
+  unsigned int  dig = (unsigned int)_mm_movemask_epi8(isdig),
+                dot = (unsigned int)_mm_movemask_epi8(isdot),
+                len, k,
+                start[4], end[4];
+  uint32_t      shuf[4];
+  /* pshufb indices that right-align an n digit octet starting at byte s
+   * into {hundreds,tens,units,0}: shuf_base[n] + s * shuf_step[n]
+   */
+  static const uint32_t shuf_base[4] = { 0, 0x80008080, 0x80010080, 0x80020100 };
+  static const uint32_t shuf_step[4] = { 0, 0x00010000, 0x00010100, 0x00010101 };
+
+  /* the entry ends at the first byte that is neither digit nor dot */
+  len = (unsigned int)__builtin_ctz(~(dig | dot) | 0x10000);
+  if (len == 16 || !is_parse_sep(s[len])) return 0;
+  dot &= (1u << len) - 1;
+  if (__builtin_popcount(dot) != 3) return 0;
+
+  start[0] = 0;
+  for (k=0;k<3;k++) {
+    end[k] = (unsigned int)__builtin_ctz(dot);
+    start[k+1] = end[k] + 1;
+    dot &= dot - 1;
+  }
+  end[3] = len;
+
+  /* right-align the digits of octet k into bytes 4k..4k+2 */
+  for (k=0;k<4;k++) {
+    unsigned int n = end[k] - start[k];
+    if (n - 1 > 2) return 0;   /* 0 or more than 3 digits */
+    shuf[k] = shuf_base[n] + start[k] * shuf_step[n];
+  }
+
+  {
+    __m128i digits = _mm_shuffle_epi8(d, _mm_setr_epi32((int)shuf[0], (int)shuf[1],
+                                                        (int)shuf[2], (int)shuf[3]));
+    __m128i weight = _mm_setr_epi8(100,10,1,0, 100,10,1,0, 100,10,1,0, 100,10,1,0);
+    __m128i octets = _mm_madd_epi16(_mm_maddubs_epi16(digits, weight),
+                                    _mm_set1_epi16(1));
+    if (_mm_movemask_epi8(_mm_cmpgt_epi32(octets, _mm_set1_epi32(255)))) return 0;
+    octets = _mm_shuffle_epi8(octets, _mm_setr_epi8(12,8,4,0, -1,-1,-1,-1,
+                                                    -1,-1,-1,-1, -1,-1,-1,-1));
+    *addr = (ipv4u32_t)_mm_cvtsi128_si32(octets);
+  }
+  return (int)len;
+}
+#endif
+
+
+size_t
+ipv4parse (ipv4u32_t      * addrs,
+           unsigned char  * errs,
+           size_t           maxn,
+           const char     * buf,
+           size_t           len,
+           size_t         * consumed)
+{
+  const char  * p = buf,
+              * e = buf + len;
+  size_t        n = 0;
+#ifdef HAVE_PARSE_SIMD
+  int           simd = __builtin_cpu_supports("ssse3");
+#endif
+
+  while (n < maxn) {
+    const char * q;
+    while (p < e && is_parse_sep(*p)) p++;
+    if (p == e) break;
+
+#ifdef HAVE_PARSE_SIMD
+    if (simd && e - p >= 16) {
+      int l = parse_quad_simd(p, &addrs[n]);
+      if (l > 0) {
+        errs[n++] = IPV4_PARSE_OK;
+        p += l;
+        continue;
       }
     }
+#endif
+    for (q=p; q<e && !is_parse_sep(*q); q++)
+      ;
+    errs[n] = (unsigned char)parse_quad(p, q, 0, &addrs[n]);
+    if (errs[n] != IPV4_PARSE_OK) addrs[n] = 0;
+    n++;
+    p = q;
   }
-  if (x != 4 ) {
-    makeipv4(addr,0,0,0,0);
-    return 0;
+
+  if (consumed) *consumed = (size_t)(p - buf);
+  return n;
+}
+
+
+/* separator of vlsm_parse_hosts() */
+static int
+is_hosts_sep (char c)
+{
+  return c == ',' || c == '.' || c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+
+/**
+ * parse the decimal at @buf[*@pos], below 2^32, and advance *@pos past it
+ * Return: 0 if Successful, -1 no digit there, -2 2^32 or above
+ */
+static int
+parse_hosts_num (const char     * buf,
+                 size_t           len,
+                 size_t         * pos,
+                 uint64_t       * value)
+{
+  size_t    p = *pos;
+  uint64_t  v = 0;
+
+  if (p == len || (unsigned char)(buf[p] - '0') > 9) return -1;
+  for (; p < len && (unsigned char)(buf[p] - '0') <= 9; p++) {
+    v = v * 10 + (uint64_t)(buf[p] - '0');
+    if (v > UINT32_MAX) return -2;
   }
-  return 1;
+  *pos = p;
+  *value = v;
+  return 0;
+}
+
+
+int
+vlsm_parse_hosts (unsigned long  * nhosts,
+                  int              cap,
+                  const char     * buf,
+                  size_t           len,
+                  size_t         * errpos)
+{
+  size_t  pos = 0;
+  int     n = 0;
+
+  while (pos < len) {
+    size_t    start = pos;
+    uint64_t  hosts,
+              count = 1;
+    int       ret,
+              i;
+
+    if (is_hosts_sep(buf[pos])) {
+      pos++;
+      continue;
+    }
+
+    /* "H" or "CxH" */
+    ret = parse_hosts_num(buf, len, &pos, &hosts);
+    if (ret == 0 && pos < len && (buf[pos] == 'x' || buf[pos] == 'X')) {
+      pos++;
+      count = hosts;
+      ret = parse_hosts_num(buf, len, &pos, &hosts);
+    }
+    if (ret == 0 && pos < len && !is_hosts_sep(buf[pos])) ret = -1;
+    if (ret == 0 && count > (uint64_t)(INT_MAX - n)) ret = -2;
+    if (ret != 0) {
+      if (errpos != NULL) *errpos = (ret == -1) ? pos : start;
+      return ret;
+    }
+
+    for (i = n; i < cap && (uint64_t)(i - n) < count; i++) {
+      nhosts[i] = (unsigned long)hosts;
+    }
+    n += (int)count;
+  }
+  return n;
+}
+
+
+/**
+ * decimal text of every octet value, built at compile time
+ * octet_str[n] holds the digits left-aligned, byte 3 is the digit count
+ */
+#define OCTET_DIGIT(n,i)  ((char)('0' + (n) / (i) % 10))
+#define OCTET_ENTRY(n)                                                    \
+  { (n) >= 100 ? OCTET_DIGIT(n,100) : (n) >= 10 ? OCTET_DIGIT(n,10) : OCTET_DIGIT(n,1), \
+    (n) >= 100 ? OCTET_DIGIT(n,10)  : (n) >= 10 ? OCTET_DIGIT(n,1)  : 0,               \
+    (n) >= 100 ? OCTET_DIGIT(n,1)   : 0,                                               \
+    (n) >= 100 ? 3 : (n) >= 10 ? 2 : 1 }
+#define OCTET_ENTRY4(n)   OCTET_ENTRY(n),    OCTET_ENTRY((n)+1),                  \
+                          OCTET_ENTRY((n)+2), OCTET_ENTRY((n)+3)
+#define OCTET_ENTRY16(n)  OCTET_ENTRY4(n),    OCTET_ENTRY4((n)+4),                \
+                          OCTET_ENTRY4((n)+8), OCTET_ENTRY4((n)+12)
+#define OCTET_ENTRY64(n)  OCTET_ENTRY16(n),   OCTET_ENTRY16((n)+16),              \
+                          OCTET_ENTRY16((n)+32), OCTET_ENTRY16((n)+48)
+
+static const char octet_str[256][4] =
+{
+  OCTET_ENTRY64(0), OCTET_ENTRY64(64), OCTET_ENTRY64(128), OCTET_ENTRY64(192)
+};
+
+
+/* append octet n at p, copies 4 bytes but only advances by the digit count */
+#define PUT_OCTET(p,n)                                                    \
+  do {                                                                    \
+    memcpy((p), octet_str[(n)], 4);                                       \
+    (p) += octet_str[(n)][3];                                             \
+  } while (0)
+
+
+size_t
+ipv4fmt (char           * buf,
+         ipv4u32_t        addr)
+{
+  char * p = buf;
+  PUT_OCTET(p, addr >> 24);
+  *p++ = '.';
+  PUT_OCTET(p, (addr >> 16) & 0xff);
+  *p++ = '.';
+  PUT_OCTET(p, (addr >> 8) & 0xff);
+  *p++ = '.';
+  PUT_OCTET(p, addr & 0xff);
+  return (size_t)(p - buf);
+}
+
+
+/* append the decimal text of n at p and return the new end */
+static char *
+put_ulong (char           * p,
+           unsigned long    n)
+{
+  char   tmp[24];
+  char * t = tmp + sizeof(tmp);
+  do {
+    *--t = (char)('0' + n % 10);
+    n /= 10;
+  } while (n);
+  memcpy(p, t, (size_t)(tmp + sizeof(tmp) - t));
+  return p + (tmp + sizeof(tmp) - t);
+}
+
+
+/* append a string literal at p */
+#define PUT_LITERAL(p,s)                                                  \
+  do {                                                                    \
+    memcpy((p), (s), sizeof(s) - 1);                                      \
+    (p) += sizeof(s) - 1;                                                 \
+  } while (0)
+
+
+size_t
+fmt_network (char              * buf,
+             const network_t   * network)
+{
+  /* format: addr/smask (dmask) | first_addr | last_addr | broadcast [uhosts] */
+  char          * p = buf;
+  ipv4u32_t       net = ipv4tou32(network->addr);
+  unsigned char   mask = network->mask;
+
+  p += ipv4fmt(p, net);
+  *p++ = '/';
+  p = put_ulong(p, mask);
+  PUT_LITERAL(p, " (");
+  p += ipv4fmt(p, masktou32(mask));
+  PUT_LITERAL(p, ") | ");
+  p += ipv4fmt(p, calfirst32(net, mask));
+  PUT_LITERAL(p, " | ");
+  p += ipv4fmt(p, callast32(net, mask));
+  PUT_LITERAL(p, " | ");
+  p += ipv4fmt(p, calbroadcast32(net, mask));
+  PUT_LITERAL(p, " [");
+  p = put_ulong(p, caluhosts(mask));
+  PUT_LITERAL(p, "]\n");
+  return (size_t)(p - buf);
 }
 
 
 void
 print_network (network_t * network)
 {
-  /* format: addr/smask [uhosts] dmask first_addr last_addr broadcast  */
-  ipv4str_t tmp_str;
-  ipv4_t tmp_addr;
-  ipv4_t dmask;
-  ipv4cpy(tmp_addr,network->addr);
-
-  /* "address" */
-  ipv4tostr(tmp_str,network->addr);
-  printf("%s",tmp_str);
-  /* "/dmask " */
-  printf("/%d ",network->mask);
-  /* "dmask" */
-  masktodot(dmask,network->mask);
-  ipv4tostr (tmp_str,dmask);
-  printf("(%s) | ",tmp_str);
-  /* "first_addr" */
-  calfirst(tmp_addr,network->addr,network->mask);
-  ipv4tostr(tmp_str,tmp_addr);
-  printf("%s | ",tmp_str);
-  /* "last_addr" */
-  callast(tmp_addr,network->addr,network->mask);
-  ipv4tostr(tmp_str,tmp_addr);
-  printf("%s | ",tmp_str);
-  /* "broadcast\n" */
-  calbroadcast(tmp_addr,network->addr,network->mask);
-  ipv4tostr(tmp_str,tmp_addr);
-  printf("%s ",tmp_str);
-  /* "[uhosts]" */
-  printf("[%ld]\n",caluhosts(network->mask));
+  char line[NETWORK_LINELEN];
+  fwrite(line, 1, fmt_network(line,network), stdout);
+}
+
+
+/* size of the output buffer of print_plan() */
+#define PLAN_BUFSIZE  (64 * 1024)
+
+int
+print_plan (FILE                  * stream,
+            const network_t       * subnets,
+            const unsigned long   * nhosts_arr,
+            int                     arrlen)
+{
+  return print_plan_pools(stream, subnets, NULL, NULL, nhosts_arr, arrlen);
+}
+
+
+size_t
+fmt_prefix (char             * buf,
+            const network_t  * net)
+{
+  char * p = buf + ipv4fmt(buf, ipv4tou32(net->addr));
+  *p++ = '/';
+  p = put_ulong(p, net->mask);
+  return (size_t)(p - buf);
+}
+
+
+int
+print_prefixes (FILE                  * stream,
+                const network_t       * nets,
+                int                     n)
+{
+  char    buf[PLAN_BUFSIZE];
+  char  * p = buf;
+  int     i;
+
+  for (i=0;i<n;i++) {
+    if (buf + sizeof(buf) - p < NETWORK_LINELEN) {
+      if (fwrite(buf, 1, (size_t)(p - buf), stream) != (size_t)(p - buf)) return -1;
+      p = buf;
+    }
+    p += fmt_prefix(p, &nets[i]);
+    *p++ = '\n';
+  }
+  if (fwrite(buf, 1, (size_t)(p - buf), stream) != (size_t)(p - buf)) return -1;
+  return 0;
+}
+
+
+int
+print_plan_pools (FILE                  * stream,
+                  const network_t       * subnets,
+                  const int             * pool_of,
+                  const network_t       * pools,
+                  const unsigned long   * nhosts_arr,
+                  int                     arrlen)
+{
+  char    buf[PLAN_BUFSIZE];
+  char  * p = buf;
+  int     i;
+
+  STATS_BEGIN(t);
+  for (i=0;i<arrlen;i++) {
+    if (buf + sizeof(buf) - p < 3 * NETWORK_LINELEN) {
+      if (fwrite(buf, 1, (size_t)(p - buf), stream) != (size_t)(p - buf)) return -1;
+      p = buf;
+    }
+    if (nhosts_arr) {
+      if (nhosts_arr[i] == 0) continue; /* due to invalid user input */
+      PUT_LITERAL(p, "# Subnet ");
+      p = put_ulong(p, nhosts_arr[i]);
+      if (pools && pool_of[i] >= 0) {
+        const network_t * pool = &pools[pool_of[i]];
+        PUT_LITERAL(p, " in pool ");
+        p += ipv4fmt(p, ipv4tou32(pool->addr));
+        *p++ = '/';
+        p = put_ulong(p, pool->mask);
+      }
+      PUT_LITERAL(p, " :\n");
+    }
+    p += fmt_network(p, &subnets[i]);
+  }
+  if (fwrite(buf, 1, (size_t)(p - buf), stream) != (size_t)(p - buf)) return -1;
+  STATS_END(STATS_FORMAT, t);
+  return 0;
 }
 
 
@@ -118,7 +559,7 @@ caluhosts (unsigned char mask)
 {
   /*if (mask < 8 || mask > 30) return 0;*/
   if (mask > 32 ) return 0;
-  else return (unsigned long)(pow(2,IPV4_BITLEN-mask) -2);
+  else return (unsigned long)prefix_table[mask].uhosts;
 }
 
 unsigned long
@@ -126,7 +567,7 @@ calahosts (unsigned char mask)
 {
   /*if (mask < 8 || mask > 30) return 0;*/
   if (mask > 32) return 0;
-  else return (unsigned long) ( pow(2,IPV4_BITLEN-mask));
+  else return (unsigned long)prefix_table[mask].ahosts;
 }
 
 
@@ -138,26 +579,32 @@ unsigned char
 calmask (unsigned long    nhosts,
          unsigned char    given_mask)
 {
-  unsigned char mask=0;
   /* check whether it is possible to address nhosts in the subnet */
-  if ( (unsigned long)(pow(2,IPV4_BITLEN-given_mask)-2) < nhosts
+  if ( given_mask > IPV4_BITLEN
+    || prefix_table[given_mask].uhosts < nhosts
     || nhosts == 0)
   {
     return 0;
   }
 
   /* determine the required net mask value */
-  unsigned char mtable_size = IPV4_BITLEN-given_mask+1;
-  int i;
-  unsigned long tmp;
-  for (i=0;i<mtable_size;i++) {
-    tmp = (unsigned long)pow(2,i);
-    if ((tmp)  > 2 && tmp -2  >= nhosts) {
-      mask = given_mask + (mtable_size - i - 1);
-      break;
-    }
-  }
-  return mask;
+  return hoststoprefix(nhosts);
+}
+
+
+/*
+ * smallest number of host bits (at least 2) that leaves room for nhosts
+ * plus the network and broadcast address, i.e. ceil(log2(nhosts+2))
+ */
+unsigned char
+hoststoprefix (unsigned long nhosts)
+{
+  uint64_t need = (uint64_t)nhosts + 2;
+  int hostbits = 64 - clz64(need - 1);
+
+  if (hostbits < 2) hostbits = 2;
+  if (hostbits > IPV4_BITLEN) return 0;
+  return (unsigned char)(IPV4_BITLEN - hostbits);
 }
 
 void
@@ -165,8 +612,7 @@ calbroadcast (ipv4_t          broadcast,
               ipv4_t          network_addr,
               unsigned char   mask)
 {
-  ipv4cpy(broadcast, network_addr);
-  ipv4add(broadcast, calahosts(mask)-1);
+  u32toipv4(broadcast, calbroadcast32(ipv4tou32(network_addr),mask));
 }
 
 
@@ -175,8 +621,7 @@ calfirst (ipv4_t           first_host_addr,
           ipv4_t           network_addr,
           unsigned char    mask )
 {
-  ipv4cpy(first_host_addr,network_addr);
-  ipv4add(first_host_addr,1);
+  u32toipv4(first_host_addr, calfirst32(ipv4tou32(network_addr),mask));
 }
 
 
@@ -185,8 +630,7 @@ callast ( ipv4_t           last_host_addr,
           ipv4_t           network_addr,
           unsigned char    mask)
 {
-  ipv4cpy(last_host_addr,network_addr);
-  ipv4add(last_host_addr,caluhosts(mask));
+  u32toipv4(last_host_addr, callast32(ipv4tou32(network_addr),mask));
 }
 
 
@@ -199,29 +643,9 @@ ipv4add ( ipv4_t          addr,
           unsigned long   nhosts)
 
 {
-  int i;
-  unsigned long max=0;
-  unsigned long x=nhosts;
-
-  /* check whether it is possible to advance addr by nhosts
-   * add current number of hosts addressed to nhosts for easier arithmetics later
-   * remarks: 10.0.1.4  = 10*2^24 + 0*2^16 + 1*2^8 + 4*2^0 hosts addressed
-   */
-  for (i=0;i<IPV4_DOTLEN;i++) {
-    max += (255-addr[i]) * pow(2,(3-i)*8);
-    nhosts += addr[i] * pow(2,(3-i)*8);
-  }
-  if (x > max) return 0;
-
-  /* carry out calculations
-   * remarks: imagine addr to be {0,0,0,0} after we get the new nhosts
-   * so we could simply calculate by / and % ...eh just read the code
-   */
-  for (i=0;i<IPV4_DOTLEN;i++) {
-    x = (unsigned long)(pow(2,(3-i)*8));
-    addr[i] = nhosts / x;
-    nhosts = nhosts % x;
-  }
+  ipv4u32_t x = ipv4tou32(addr);
+  if (ipv4add32(&x,nhosts) == 0) return 0;
+  u32toipv4(addr,x);
   return 1;
 }
 
@@ -247,9 +671,7 @@ masktodot ( ipv4_t          dmask,
             unsigned char   smask)
 
 {
-  ipv4_t addr = {0,0,0,0};
-  ipv4add (addr, pow(2,32)-pow(2,32-smask) ); /* 2^32 - 2^host_bit */
-  ipv4cpy (dmask,addr);
+  u32toipv4 (dmask, masktou32(smask));
 }
 
 
@@ -257,17 +679,11 @@ masktodot ( ipv4_t          dmask,
 unsigned char
 masktoslash ( ipv4_t dmask )
 {
-  int i,j;
-  unsigned char map[9] = {0,128,192,224,240,248,252,254,255};
-  unsigned char smask=0;
-  for (i=0;i<IPV4_DOTLEN;i++) {
-    for(j=0;j<9;j++) {
-      if (dmask[i] == map[j] ) {
-        smask += j;
-      }
-    }
-  }
-  return smask;
+  ipv4u32_t wildcard = ~ipv4tou32(dmask);
+
+  /* a valid wildcard is a run of 1s at the bottom: 0..01..1 */
+  if (wildcard & (wildcard + 1)) return 0;
+  return (unsigned char)(clz64((uint64_t)wildcard + 1) - (64 - IPV4_BITLEN - 1));
 }
 
 /**
@@ -277,13 +693,7 @@ void ipv4tonet (ipv4_t                netaddr,
                 const ipv4_t          addr,
                 const unsigned char   smask)
 {
-  int i;
-  ipv4_t dmask;
-
-  masktodot (dmask, smask);
-  for (i=0;i<IPV4_DOTLEN;i++) {
-    netaddr[i] = addr[i] & dmask[i]; // AND-ing operations
-  }
+  u32toipv4 (netaddr, ipv4tonet32(ipv4tou32(addr), smask));
 }
 
 
@@ -297,13 +707,84 @@ makenetwork ( network_t               * network,
 }
 
 
+/**
+ * free space of vlsm(): aligned blocks kept per order (log2 of the block
+ * size). Blocks are only ever created by splitting off buddies or by
+ * cutting a range into maximal aligned pieces, so no two free blocks are
+ * buddies of each other and every order holds at most 2 blocks.
+ */
+typedef struct
+{
+  uint64_t    blk[IPV4_BITLEN + 1][2];
+  int         n[IPV4_BITLEN + 1];
+} freeblk_t;
+
+
+/* cut [start,end) into maximal aligned blocks */
+static void
+freeblk_init (freeblk_t  * fb,
+              uint64_t     start,
+              uint64_t     end)
+{
+  memset(fb->n, 0, sizeof(fb->n));
+  while (start < end) {
+    int order = (start == 0) ? IPV4_BITLEN : ctz64(start);
+    if (order > IPV4_BITLEN) order = IPV4_BITLEN;
+    while (start + ((uint64_t)1 << order) > end) order--;
+    fb->blk[order][fb->n[order]++] = start;
+    start += (uint64_t)1 << order;
+  }
+}
+
+
+/**
+ * take a block of 2^order addresses from the smallest free block that
+ * holds it, lowest address first. Return 0 if there is none
+ */
+static int
+freeblk_take (freeblk_t  * fb,
+              int          order,
+              uint64_t   * addr)
+{
+  int       j, t;
+  uint64_t  a;
+
+  for (j=order; j<=IPV4_BITLEN && fb->n[j]==0; j++)
+    ;
+  if (j > IPV4_BITLEN) return 0;
+
+  if (fb->n[j] == 2 && fb->blk[j][1] < fb->blk[j][0]) {
+    a = fb->blk[j][1];
+  } else {
+    a = fb->blk[j][0];
+    fb->blk[j][0] = fb->blk[j][1];
+  }
+  fb->n[j]--;
+
+  /* orders order..j-1 are empty, give each the upper buddy of the split */
+  for (t=j-1; t>=order; t--) {
+    fb->blk[t][fb->n[t]++] = a + ((uint64_t)1 << t);
+  }
+  *addr = a;
+  return 1;
+}
+
+
 /* address an array of "network" of representing subnets by VLSM
  * assume "*subnets" has "sizeof(network_t)*arrlen "
+ *
+ * the address space is the base network net_addr/net_mask, used with the
+ * host bits of net_addr cleared.
+ * subnets are placed largest first (in input order among equal sizes),
+ * each on a boundary aligned to its own size, taking the smallest free
+ * block that holds it. This fails only if no aligned placement exists.
+ * requirements of 0 host get {base network address, 0} and take no space
+ * runs in O(d*arrlen) for d distinct subnet sizes and allocates nothing
+ *
  * return :
  *     >=0: successful & the number of subnets
  *     -1: invalid net_mask
  *     -2: too many or no host to address for the given network
- *TODO: detect(ignore?) cases where request no. of host to subnet is 0
  */
 int
 vlsm ( network_t              * subnets,
@@ -312,29 +793,612 @@ vlsm ( network_t              * subnets,
        const unsigned long    * nhosts_arr,
        const int                arrlen )
 {
-  int i;
+  int         i,
+              m,
+              nsubnets=0;
+  int         count[IPV4_BITLEN + 1];
+  uint64_t    start,
+              end,
+              addr;
+  ipv4_t      base;
+  freeblk_t   fb;
 
   /* some checking */
-  {
-    if (arrlen == 0 ) return 0;
-    if (net_mask > 30 || net_mask <= 0) return -1;
-    unsigned long sum=0;
-    for (i=0;i<arrlen;i++) {
-      sum  += nhosts_arr[i];
+  if (arrlen == 0 ) return 0;
+  if (net_mask > 30 || net_mask <= 0) return -1;
+  start = ipv4tonet32(ipv4tou32(net_addr), net_mask);
+  u32toipv4(base, (ipv4u32_t)start);
+
+  /* required prefix of every subnet, kept in subnets[i].mask for now */
+  STATS_BEGIN(t_check);
+  memset(count, 0, sizeof(count));
+  for (i=0;i<arrlen;i++) {
+    if (nhosts_arr[i] == 0) {
+      makenetwork(&subnets[i], base, 0);
+      continue;
     }
-    if (calmask(sum,net_mask) == 0 ) return -2;
+    m = calmask(nhosts_arr[i], net_mask);
+    if (m == 0) return -2;
+    subnets[i].mask = (unsigned char)m;
+    count[m]++;
+    nsubnets++;
   }
+  if (nsubnets == 0) return -2;
+  STATS_END(STATS_CHECK, t_check);
 
   /* Process */
-  makenetwork(&subnets[0],net_addr, calmask(nhosts_arr[0],net_mask) );
-  for (i=1;i<arrlen;i++) {
-    unsigned char sub_mask = calmask(nhosts_arr[i],net_mask);
-    ipv4_t        sub_addr;
-    ipv4cpy(sub_addr,subnets[i-1].addr);
-    ipv4add(sub_addr,calahosts(subnets[i-1].mask));
+  STATS_BEGIN(t_alloc);
+  end = start + calahosts(net_mask);
+  if (end > (uint64_t)1 << IPV4_BITLEN) end = (uint64_t)1 << IPV4_BITLEN;
+  freeblk_init(&fb, start, end);
+
+  for (m=net_mask; m<=IPV4_BITLEN; m++) {
+    if (count[m] == 0) continue;
+    for (i=0;i<arrlen;i++) {
+      if (subnets[i].mask != m) continue;
+      if (!freeblk_take(&fb, IPV4_BITLEN - m, &addr)) return -2;
+      u32toipv4(subnets[i].addr, (ipv4u32_t)addr);
+    }
+  }
+  STATS_END(STATS_ALLOCATE, t_alloc);
+  return arrlen;
+}
+
+
+
+size_t
+vlsm_ws_size (int cap)
+{
+  if (cap < 0) cap = 0;
+  return (sizeof(unsigned long) + sizeof(network_t)) * (size_t)cap;
+}
+
+
+int
+vlsm_ws_init (vlsm_ws_t  * ws,
+              void       * mem,
+              size_t       len)
+{
+  size_t cap = len / (sizeof(unsigned long) + sizeof(network_t));
+
+  if (cap > INT_MAX) cap = INT_MAX;
+  ws->nhosts = (unsigned long *)mem;
+  ws->subnets = (network_t *)(ws->nhosts + cap);
+  ws->cap = (int)cap;
+  return ws->cap;
+}
+
+
+int
+vlsm_ws_solve (vlsm_ws_t        * ws,
+               const network_t  * base,
+               int                arrlen)
+{
+  if (arrlen > ws->cap) return -3;
+  return vlsm(ws->subnets, base->addr, base->mask, ws->nhosts, arrlen);
+}
+
+
+/**
+ * free blocks of one order over all pools of vlsm_multi(), a min-heap
+ * by address
+ */
+typedef struct
+{
+  uint64_t    addr;
+  int         pool;
+} poolblk_t;
+
+typedef struct
+{
+  poolblk_t * blk;
+  int         n,
+              cap;
+} blkheap_t;
+
+
+static int
+blkheap_push (blkheap_t  * h,
+              uint64_t     addr,
+              int          pool)
+{
+  int i;
+
+  if (h->n == h->cap) {
+    int         cap = h->cap ? h->cap * 2 : 16;
+    poolblk_t * blk = (poolblk_t *) realloc (h->blk, sizeof(poolblk_t) * cap);
+    if (blk == NULL) return 0;
+    h->blk = blk;
+    h->cap = cap;
+  }
+  for (i=h->n++; i>0 && h->blk[(i-1)/2].addr > addr; i=(i-1)/2) {
+    h->blk[i] = h->blk[(i-1)/2];
+  }
+  h->blk[i].addr = addr;
+  h->blk[i].pool = pool;
+  return 1;
+}
+
+
+static poolblk_t
+blkheap_pop (blkheap_t * h)
+{
+  poolblk_t top = h->blk[0],
+            last = h->blk[--h->n];
+  int       i = 0,
+            c;
+
+  while ((c = 2 * i + 1) < h->n) {
+    if (c + 1 < h->n && h->blk[c+1].addr < h->blk[c].addr) c++;
+    if (last.addr <= h->blk[c].addr) break;
+    h->blk[i] = h->blk[c];
+    i = c;
+  }
+  h->blk[i] = last;
+  return top;
+}
+
+
+/* pools as [start,end), ordered by start */
+typedef struct
+{
+  uint64_t    start,
+              end;
+} poolspan_t;
+
+static int
+poolspan_cmp (const void * a,
+              const void * b)
+{
+  uint64_t x = ((const poolspan_t *)a)->start,
+           y = ((const poolspan_t *)b)->start;
+  return (x > y) - (x < y);
+}
+
+
+int
+vlsm_multi (network_t              * subnets,
+            int                    * pool_of,
+            const network_t        * pools,
+            int                      npools,
+            const unsigned long    * nhosts_arr,
+            int                      arrlen)
+{
+  blkheap_t     heap[IPV4_BITLEN + 1];
+  poolspan_t  * span;
+  int           count[IPV4_BITLEN + 1];
+  int           i,
+                m,
+                nsubnets = 0,
+                ret = arrlen;
+
+  if (arrlen == 0) return 0;
+  if (npools <= 0) return -1;
+
+  /* every pool valid, none overlapping */
+  span = (poolspan_t *) malloc (sizeof(poolspan_t) * npools);
+  if (span == NULL) return -3;
+  for (i=0;i<npools;i++) {
+    if (pools[i].mask > 30 || pools[i].mask <= 0) {
+      free(span);
+      return -1;
+    }
+    span[i].start = ipv4tonet32(ipv4tou32(pools[i].addr), pools[i].mask);
+    span[i].end = span[i].start + calahosts(pools[i].mask);
+    if (span[i].end > (uint64_t)1 << IPV4_BITLEN) span[i].end = (uint64_t)1 << IPV4_BITLEN;
+  }
+  qsort(span, npools, sizeof(poolspan_t), poolspan_cmp);
+  for (i=1;i<npools;i++) {
+    if (span[i].start < span[i-1].end) {
+      free(span);
+      return -1;
+    }
+  }
+  free(span);
+
+  /* required prefix of every subnet, kept in subnets[i].mask for now */
+  memset(count, 0, sizeof(count));
+  for (i=0;i<arrlen;i++) {
+    pool_of[i] = -1;
+    if (nhosts_arr[i] == 0) {
+      u32toipv4(subnets[i].addr, ipv4tonet32(ipv4tou32(pools[0].addr), pools[0].mask));
+      subnets[i].mask = 0;
+      continue;
+    }
+    m = calmask(nhosts_arr[i], 1);
+    if (m == 0) return -2;
+    subnets[i].mask = (unsigned char)m;
+    count[m]++;
+    nsubnets++;
+  }
+  if (nsubnets == 0) return -2;
+
+  /* cut every pool into maximal aligned blocks */
+  memset(heap, 0, sizeof(heap));
+  for (i=0; i<npools && ret>=0; i++) {
+    uint64_t start = ipv4tonet32(ipv4tou32(pools[i].addr), pools[i].mask),
+             end = start + calahosts(pools[i].mask);
+    if (end > (uint64_t)1 << IPV4_BITLEN) end = (uint64_t)1 << IPV4_BITLEN;
+    while (start < end && ret >= 0) {
+      int order = (start == 0) ? IPV4_BITLEN : ctz64(start);
+      if (order > IPV4_BITLEN) order = IPV4_BITLEN;
+      while (start + ((uint64_t)1 << order) > end) order--;
+      if (!blkheap_push(&heap[order], start, i)) ret = -3;
+      start += (uint64_t)1 << order;
+    }
+  }
+
+  /* largest first, each from the smallest free block that holds it */
+  for (m=1; m<=IPV4_BITLEN && ret>=0; m++) {
+    if (count[m] == 0) continue;
+    for (i=0; i<arrlen && ret>=0; i++) {
+      int       order = IPV4_BITLEN - m,
+                j,
+                t;
+      poolblk_t b;
+
+      if (subnets[i].mask != m || nhosts_arr[i] == 0) continue;
+      for (j=order; j<=IPV4_BITLEN && heap[j].n==0; j++)
+        ;
+      if (j > IPV4_BITLEN) {
+        ret = -2;
+        break;
+      }
+      b = blkheap_pop(&heap[j]);
+      for (t=j-1; t>=order; t--) {
+        if (!blkheap_push(&heap[t], b.addr + ((uint64_t)1 << t), b.pool)) ret = -3;
+      }
+      u32toipv4(subnets[i].addr, (ipv4u32_t)b.addr);
+      pool_of[i] = b.pool;
+    }
+  }
+
+  for (m=0;m<=IPV4_BITLEN;m++) free(heap[m].blk);
+  return ret;
+}
+
+
+
+/**
+ * sort @n keys of at most 39 bits, LSD radix with 13 bit digits.
+ * RETURN whichever of @keys and @tmp holds the sorted keys
+ */
+#define SORT_DIGIT  13
+
+static uint64_t *
+sort_keys (uint64_t   * keys,
+           uint64_t   * tmp,
+           size_t       n)
+{
+  size_t  count[1 << SORT_DIGIT];
+  int     shift;
+
+  for (shift=0; shift<3*SORT_DIGIT; shift+=SORT_DIGIT) {
+    uint64_t  * t;
+    size_t      i,
+                sum = 0;
+
+    memset(count, 0, sizeof(count));
+    for (i=0;i<n;i++) count[(keys[i] >> shift) & ((1 << SORT_DIGIT) - 1)]++;
+    for (i=0;i<(1 << SORT_DIGIT);i++) {
+      size_t c = count[i];
+      count[i] = sum;
+      sum += c;
+    }
+    for (i=0;i<n;i++) tmp[count[(keys[i] >> shift) & ((1 << SORT_DIGIT) - 1)]++] = keys[i];
+    t = keys;
+    keys = tmp;
+    tmp = t;
+  }
+  return keys;
+}
+
+
+/**
+ * store the fewest prefixes covering [start,end) to @nets, or just count
+ * them if @nets is NULL. RETURN how many
+ */
+static int
+cover_range (network_t  * nets,
+             uint64_t     start,
+             uint64_t     end)
+{
+  int n = 0;
+
+  while (start < end) {
+    int order = (start == 0) ? IPV4_BITLEN : ctz64(start);
+    if (order > IPV4_BITLEN) order = IPV4_BITLEN;
+    while (start + ((uint64_t)1 << order) > end) order--;
+    if (nets != NULL) {
+      u32toipv4(nets[n].addr, (ipv4u32_t)start);
+      nets[n].mask = (unsigned char)(IPV4_BITLEN - order);
+    }
+    n++;
+    start += (uint64_t)1 << order;
+  }
+  return n;
+}
+
+
+int
+vlsm_summarize (network_t  * nets,
+                int          n)
+{
+  uint64_t  * keys,
+            * sorted,
+              start = 0,
+              end = 0;
+  int         i,
+              out = 0;
+
+  if (n <= 0) return 0;
+  keys = (uint64_t *) malloc (sizeof(uint64_t) * 2 * (size_t)n);
+  if (keys == NULL) return -3;
+
+  /* key: network address << 6 | mask, so a range sorts by its start */
+  for (i=0;i<n;i++) {
+    unsigned char mask = nets[i].mask > IPV4_BITLEN ? IPV4_BITLEN : nets[i].mask;
+    keys[i] = (uint64_t)(ipv4tou32(nets[i].addr) & prefix_table[mask].mask) << 6 | mask;
+  }
+  sorted = sort_keys(keys, keys + n, (size_t)n);
+
+  /*
+   * merge overlapping and adjacent ranges. The cover of the merged ranges
+   * never has more prefixes than went into them, so the output does not
+   * overtake the input, which is in @keys by now anyway
+   */
+  for (i=0;i<n;i++) {
+    uint64_t s = sorted[i] >> 6,
+             e = s + prefix_table[sorted[i] & 63].ahosts;
+    if (i > 0 && s <= end) {
+      if (e > end) end = e;
+      continue;
+    }
+    if (i > 0) out += cover_range(nets + out, start, end);
+    start = s;
+    end = e;
+  }
+  out += cover_range(nets + out, start, end);
+
+  free(keys);
+  return out;
+}
+
+
+
+/**
+ * the gaps of @base between the @n sorted, disjoint prefixes @used, as
+ * prefixes stored to @blocks, or just counted if @blocks is NULL.
+ * RETURN how many
+ */
+static int
+free_blocks (network_t        * blocks,
+             const network_t  * base,
+             const network_t  * used,
+             int                n)
+{
+  uint64_t  cur = ipv4tonet32(ipv4tou32(base->addr), base->mask),
+            end = cur + prefix_table[base->mask].ahosts;
+  int       i,
+            count = 0;
+
+  for (i=0;i<n && cur<end;i++) {
+    uint64_t s = ipv4tou32(used[i].addr),
+             e = s + prefix_table[used[i].mask].ahosts;
+    if (e <= cur) continue;
+    if (s >= end) break;
+    if (s > cur) count += cover_range(blocks ? blocks + count : NULL, cur, s);
+    cur = e;
+  }
+  if (cur < end) count += cover_range(blocks ? blocks + count : NULL, cur, end);
+  return count;
+}
+
 
-    makenetwork(&subnets[i],sub_addr, sub_mask);
+int
+vlsm_free_space (network_t        ** blocks,
+                 uint64_t          * total,
+                 unsigned char     * largest,
+                 const network_t   * base,
+                 const network_t   * subnets,
+                 int                 n)
+{
+  network_t * used;
+  int         i,
+              m = 0,
+              count;
+
+  *blocks = NULL;
+  *total = 0;
+  *largest = 0;
+  if (base->mask > IPV4_BITLEN) return -1;
+
+  /* the used space as sorted, disjoint prefixes */
+  used = (network_t *) malloc (sizeof(network_t) * ((size_t)(n > 0 ? n : 0) + 1));
+  if (used == NULL) return -3;
+  for (i=0;i<n;i++) {
+    if (subnets[i].mask != 0) used[m++] = subnets[i];
+  }
+  m = vlsm_summarize(used, m);
+  if (m < 0) {
+    free(used);
+    return -3;
+  }
+
+  count = free_blocks(NULL, base, used, m);
+  *blocks = (network_t *) malloc (sizeof(network_t) * ((size_t)count + 1));
+  if (*blocks == NULL) {
+    free(used);
+    return -3;
+  }
+  free_blocks(*blocks, base, used, m);
+  free(used);
+
+  for (i=0;i<count;i++) {
+    *total += prefix_table[(*blocks)[i].mask].ahosts;
+    if (i == 0 || (*blocks)[i].mask < *largest) *largest = (*blocks)[i].mask;
   }
-  return i;
+  return count;
+}
+
+
+/* a prefix of vlsm_overlaps() as its range and index */
+typedef struct
+{
+  uint64_t    start,
+              end;
+  int         idx;
+} span_t;
+
+static int
+span_cmp (const void * a,
+          const void * b)
+{
+  const span_t * x = (const span_t *)a,
+               * y = (const span_t *)b;
+  if (x->start != y->start) return (x->start > y->start) - (x->start < y->start);
+  if (x->end != y->end) return (x->end < y->end) - (x->end > y->end);  /* longer first */
+  return (x->idx > y->idx) - (x->idx < y->idx);
 }
 
+
+long
+vlsm_overlaps (const network_t  * nets,
+               int                n,
+               overlap_fn         fn,
+               void             * data)
+{
+  span_t  * spans;
+  int     * open;
+  int       i,
+            k,
+            m = 0,
+            nopen = 0,
+            cap = (IPV4_BITLEN + 1) * 2;
+  long      count = 0;
+
+  if (n <= 0) return 0;
+  spans = (span_t *) malloc (sizeof(span_t) * (size_t)n);
+  open = (int *) malloc (sizeof(int) * (size_t)cap);
+  if (spans == NULL || open == NULL) {
+    free(spans);
+    free(open);
+    return -3;
+  }
+  for (i=0;i<n;i++) {
+    unsigned char mask = nets[i].mask > IPV4_BITLEN ? IPV4_BITLEN : nets[i].mask;
+    if (mask == 0) continue;
+    spans[m].start = ipv4tou32(nets[i].addr) & prefix_table[mask].mask;
+    spans[m].end = spans[m].start + prefix_table[mask].ahosts;
+    spans[m++].idx = i;
+  }
+  qsort(spans, (size_t)m, sizeof(span_t), span_cmp);
+
+  /*
+   * open[] holds the prefixes that hold the current one, outermost first.
+   * Nested prefixes are at most 33 deep, or equal ones, so it grows
+   * only for many copies of one prefix
+   */
+  for (i=0;i<m;i++) {
+    while (nopen > 0 && spans[open[nopen-1]].end <= spans[i].start) nopen--;
+    count += nopen;
+    if (fn != NULL) {
+      for (k=0;k<nopen;k++) fn(data, spans[open[k]].idx, spans[i].idx);
+    }
+    if (nopen == cap) {
+      int * p = (int *) realloc (open, sizeof(int) * (size_t)cap * 2);
+      if (p == NULL) {
+        free(spans);
+        free(open);
+        return -3;
+      }
+      open = p;
+      cap *= 2;
+    }
+    open[nopen++] = i;
+  }
+
+  free(spans);
+  free(open);
+  return count;
+}
+
+
+
+/*** 32-bit integer address core ***/
+
+ipv4u32_t
+ipv4tou32 (const ipv4_t addr)
+{
+  return ((ipv4u32_t)addr[0] << 24) | ((ipv4u32_t)addr[1] << 16)
+       | ((ipv4u32_t)addr[2] << 8)  |  (ipv4u32_t)addr[3];
+}
+
+
+void
+u32toipv4 (ipv4_t       addr,
+           ipv4u32_t    n)
+{
+  addr[0] = (unsigned char)(n >> 24);
+  addr[1] = (unsigned char)(n >> 16);
+  addr[2] = (unsigned char)(n >> 8);
+  addr[3] = (unsigned char) n;
+}
+
+
+/**
+ * net mask in slash form to its 32-bit value, e.g. 24 -> 0xffffff00
+ * behaviour is undefined if smask > 32
+ */
+ipv4u32_t
+masktou32 (unsigned char smask)
+{
+  return prefix_table[smask].mask;
+}
+
+
+/**
+ * advance addr by nhosts, leave addr untouched if the result
+ * would go beyond 255.255.255.255
+ * return 0 if fail, non-zero if successful
+ */
+int
+ipv4add32 (ipv4u32_t      * addr,
+           unsigned long    nhosts)
+{
+  if ((uint64_t)nhosts > (uint64_t)(0xffffffffU - *addr)) return 0;
+  *addr += (ipv4u32_t)nhosts;
+  return 1;
+}
+
+
+ipv4u32_t
+calbroadcast32 (ipv4u32_t       network_addr,
+                unsigned char   mask)
+{
+  return network_addr + (ipv4u32_t)(calahosts(mask) - 1);
+}
+
+
+ipv4u32_t
+calfirst32 (ipv4u32_t       network_addr,
+            unsigned char   mask)
+{
+  return network_addr + 1;
+}
+
+
+ipv4u32_t
+callast32 (ipv4u32_t       network_addr,
+           unsigned char   mask)
+{
+  return network_addr + (ipv4u32_t)caluhosts(mask);
+}
+
+
+ipv4u32_t
+ipv4tonet32 (ipv4u32_t       addr,
+             unsigned char   smask)
+{
+  return addr & masktou32(smask);
+}
@@ -22,6 +22,11 @@ extern "C" {
 
 #ifndef VLSM_H
 #define VLSM_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+
 #define VLSM_VERSION "v1.2.1"
 
 #define IPV4_DOTLEN 4
@@ -31,6 +36,8 @@ extern "C" {
 typedef   unsigned char     ipv4_t        [IPV4_DOTLEN];
 typedef   char              ipv4str_t     [IPV4_STRLEN];
 typedef   char              networkstr_t  [20];  
+#define NETWORK_LINELEN 128   /* longest line of fmt_network() plus slack */
+typedef   uint32_t          ipv4u32_t;    /* host byte order, a.b.c.d = a<<24|b<<16|c<<8|d */
 
 
 typedef struct 
@@ -39,6 +46,24 @@ typedef struct
   unsigned char     mask;
 } network_t;
 
+
+/**
+ * properties of one prefix length, see prefix_table
+ */
+typedef struct
+{
+  ipv4u32_t         mask;       /* /24 -> 0xffffff00 */
+  ipv4u32_t         wildcard;   /* /24 -> 0x000000ff */
+  ipv4_t            dmask;      /* /24 -> {255,255,255,0} */
+  uint64_t          ahosts;     /* addressable hosts, include net addr & broadcast */
+  uint64_t          uhosts;     /* usable hosts, 0 for /31 and /32 */
+} prefix_t;
+
+/**
+ * lookup table indexed by prefix length 0..32, built at compile time
+ */
+extern const prefix_t prefix_table[IPV4_BITLEN + 1];
+
 /**** Function prototypes ****/
 
 /**
@@ -55,12 +80,173 @@ int                   strtoipv4           (ipv4_t             addr,
                                            const ipv4str_t    ipstr);
                                            
                                                                                        
+/**
+ * error codes stored by ipv4parse() for each entry
+ */
+#define IPV4_PARSE_OK       0
+#define IPV4_PARSE_ECHAR    1   /* character other than digit or dot */
+#define IPV4_PARSE_EOCTETS  2   /* not exactly 4 octets, or an empty octet */
+#define IPV4_PARSE_ERANGE   3   /* octet above 255 or longer than 3 digits */
+
+/**
+ * parse up to @maxn dotted quads from @buf (@len bytes, need not be
+ * NUL-terminated) separated by newlines, commas or blanks.
+ * For entry i, @addrs[i] gets the address (0 on error) and @errs[i] one of
+ * IPV4_PARSE_*. Empty entries are skipped. If @consumed is not NULL it
+ * gets the number of bytes consumed, so a caller may resume from there.
+ * Uses SSSE3 when the CPU supports it. No memory is allocated.
+ * Return: number of entries stored
+ */
+size_t                ipv4parse           (ipv4u32_t        * addrs,
+                                           unsigned char    * errs,
+                                           size_t             maxn,
+                                           const char       * buf,
+                                           size_t             len,
+                                           size_t           * consumed);
+
+
+/**
+ * parse the host numbers in @buf (@len bytes, need not be NUL-terminated)
+ * separated by commas, dots or blanks (spaces, tabs, newlines) into
+ * @nhosts. "CxH" stands for C subnets of H hosts, so "3x50" is the same
+ * as "50,50,50". Empty entries are skipped. Only the first @cap numbers
+ * are stored but all are counted, so a caller may make room for the
+ * return value and parse again. One pass, no memory is allocated
+ * Return: the number of host numbers in @buf, or
+ *   -1  : not a number, *@errpos gets the offset of the bad character
+ *   -2  : a number of 2^32 or above, or more than INT_MAX numbers in all,
+ *         *@errpos gets the offset of the entry
+ */
+int                   vlsm_parse_hosts    (unsigned long    * nhosts,
+                                           int                cap,
+                                           const char       * buf,
+                                           size_t             len,
+                                           size_t           * errpos);
+
+
+/**
+ * render @addr in dot form at @buf, without a terminating \0
+ * @buf must have room for IPV4_STRLEN bytes
+ * Return: number of characters written
+ */
+size_t                ipv4fmt             (char             * buf,
+                                           ipv4u32_t          addr);
+
+
+/**
+ * render @network as one line of print_network() output at @buf,
+ * without a terminating \0. @buf must have room for NETWORK_LINELEN bytes
+ * Return: number of characters written
+ */
+size_t                fmt_network         (char             * buf,
+                                           const network_t  * network);
+
+
 /**
  * print network information to stdout
  */
 void                  print_network       (network_t        * network);
 
 
+/**
+ * print @arrlen subnets to @stream in print_network() format, buffered
+ * into large blocks. If @nhosts_arr is not NULL every subnet is preceded
+ * by a "# Subnet <nhosts> :" line and subnets of 0 hosts are skipped
+ * Return: 0 if successful, -1 on write error
+ */
+int                   print_plan          (FILE                  * stream,
+                                           const network_t       * subnets,
+                                           const unsigned long   * nhosts_arr,
+                                           int                     arrlen);
+
+
+/**
+ * replace the @n networks in @nets with the fewest prefixes covering
+ * exactly the same addresses, in address order. @nets may overlap and
+ * be in any order, host bits of an address are ignored. Sorts and merges
+ * address ranges, linear time apart from the radix sort
+ * Return:
+ *   >=0 : number of prefixes left in @nets, never more than @n
+ *   -3  : out of memory
+ */
+int                   vlsm_summarize      (network_t            * nets,
+                                           int                    n);
+
+
+/**
+ * the space of @base not taken by any of the @n @subnets, as the fewest
+ * prefixes, in address order, stored to a new array @*blocks for the
+ * caller to free(). @subnets may be in any order and overlap; entries of
+ * mask 0, requirements of 0 host, take nothing. @*total gets the number
+ * of free addresses, @*largest the shortest free prefix (0 if none).
+ * Linear time, see vlsm_summarize()
+ * Return:
+ *   >=0 : number of free blocks
+ *   -1  : invalid mask of @base
+ *   -3  : out of memory
+ */
+int                   vlsm_free_space     (network_t           ** blocks,
+                                           uint64_t             * total,
+                                           unsigned char        * largest,
+                                           const network_t      * base,
+                                           const network_t      * subnets,
+                                           int                    n);
+
+
+/**
+ * called by vlsm_overlaps() for every overlapping pair @a, @b of indices
+ * into its @nets. Prefixes overlap only if one holds the other; @a is
+ * the one holding @b, or the first of two equal ones
+ */
+typedef void        (*overlap_fn)         (void                 * data,
+                                           int                    a,
+                                           int                    b);
+
+/**
+ * find every pair of overlapping networks among the @n @nets, in any
+ * order. Entries of mask 0, requirements of 0 host, overlap nothing.
+ * Sorts the address ranges, then sweeps them keeping the prefixes that
+ * hold the current one: O(n log n) plus the number of pairs
+ * Return:
+ *   >=0 : number of overlapping pairs, each passed to @fn if not NULL
+ *   -3  : out of memory
+ */
+long                  vlsm_overlaps       (const network_t      * nets,
+                                           int                    n,
+                                           overlap_fn             fn,
+                                           void                 * data);
+
+
+/**
+ * render @net as "a.b.c.d/m" at @buf, without a terminating \0
+ * @buf must have room for 19 bytes
+ * Return: number of characters written
+ */
+size_t                fmt_prefix          (char                  * buf,
+                                           const network_t       * net);
+
+
+/**
+ * print the @n networks @nets to @stream, one "a.b.c.d/m" per line
+ * Return: 0 if Successful, -1 write error
+ */
+int                   print_prefixes      (FILE                  * stream,
+                                           const network_t       * nets,
+                                           int                     n);
+
+
+/**
+ * print_plan() for vlsm_multi(): the header of every subnet also names
+ * its pool, @pools[@pool_of[i]]
+ */
+int                   print_plan_pools    (FILE                  * stream,
+                                           const network_t       * subnets,
+                                           const int             * pool_of,
+                                           const network_t       * pools,
+                                           const unsigned long   * nhosts_arr,
+                                           int                     arrlen);
+
+
 
 /* initialize @addr with the given ip {a,b,c,d}
  */
@@ -94,6 +280,15 @@ unsigned long         calahosts           (unsigned char      mask);
  */
 unsigned char         calmask             (unsigned long      nhosts,
                                            unsigned char      mask);
+
+
+
+/**
+ * RETURN the longest prefix (smallest network) with at least @nhosts usable
+ * hosts, regardless of any base network. Constant time.
+ * Return 0 if @nhosts cannot be addressed even by /0
+ */
+unsigned char         hoststoprefix       (unsigned long      nhosts);
                                            
                                            
                                                
@@ -179,12 +374,18 @@ void                  makenetwork         (network_t            * network,
                                            
 /**
  * perform subneting calculation with given parameters
- * store an array of network_t to @subnets
+ * store an array of network_t to @subnets, in the order of @nhosts_arr
  * assuming @subnets has been allocated with memory sizeof(network_t)*arrlen
+ * subnets are allocated largest first, each aligned to its own size, from
+ * the base network @net_addr/@net_mask: the 2^(32-@net_mask) addresses
+ * from @net_addr with its host bits cleared (ipv4tonet32()), the rule
+ * every pool in this program follows. A requirement of 0 host gets
+ * {base address, 0}
  * Return: 
  *   >=0 : Successful
  *   -1  : invalid net_mask
- *   -2  : too many or no host to address for the given network
+ *   -2  : too many or no host to address for the given network,
+ *         i.e. the subnets cannot all be placed on aligned boundaries
  */
 int                   vlsm                (network_t            * subnets,
                                            const ipv4_t           net_addr,
@@ -192,6 +393,121 @@ int                   vlsm                (network_t            * subnets,
                                            const unsigned long  * nhosts_arr,
                                            const int              arrlen);
 
+
+
+/**
+ * the arrays of a solve, laid over one block of memory owned by the
+ * caller, see vlsm_ws_init(). Solving with it allocates nothing, so a
+ * workspace reused in a loop costs no malloc at all
+ */
+typedef struct
+{
+  unsigned long       * nhosts;     /* requirements, filled by the caller */
+  network_t           * subnets;    /* results of vlsm_ws_solve() */
+  int                   cap;        /* room for this many requirements */
+} vlsm_ws_t;
+
+
+/**
+ * RETURN the bytes of workspace memory for @cap requirements
+ */
+size_t                vlsm_ws_size        (int                    cap);
+
+
+/**
+ * lay out @ws over the @len bytes at @mem, which must be aligned for
+ * unsigned long (as from malloc() or an unsigned long array)
+ * Return: the number of requirements @ws has room for
+ */
+int                   vlsm_ws_init        (vlsm_ws_t            * ws,
+                                           void                 * mem,
+                                           size_t                 len);
+
+
+/**
+ * vlsm() of the first @arrlen requirements of @ws into ws->subnets
+ * Return: as vlsm(), or
+ *   -3  : @arrlen above ws->cap
+ */
+int                   vlsm_ws_solve       (vlsm_ws_t            * ws,
+                                           const network_t      * base,
+                                           int                    arrlen);
+
+
+/**
+ * vlsm() over the @npools base networks @pools at once, which must not
+ * overlap. Every subnet goes to the smallest free aligned block of any
+ * pool that holds it, lowest address first, so big blocks are only split
+ * when nothing smaller is left. With a single pool the result is the same
+ * as vlsm(). @pool_of[i] gets the index of the pool of subnet i, -1 for a
+ * requirement of 0 host, which gets {base address of pools[0], 0}.
+ * Host bits of a pool address are cleared as in vlsm()
+ * Return:
+ *   >=0 : Successful
+ *   -1  : invalid net mask of a pool, or pools overlap
+ *   -2  : too many or no host to address for the given networks
+ *   -3  : out of memory
+ */
+int                   vlsm_multi          (network_t            * subnets,
+                                           int                  * pool_of,
+                                           const network_t      * pools,
+                                           int                    npools,
+                                           const unsigned long  * nhosts_arr,
+                                           int                    arrlen);
+
+
+
+/**** 32-bit integer address core ****
+ * The functions above are thin wrappers around these. They work on a
+ * plain ipv4u32_t so that no byte-by-byte carrying is needed.
+ */
+
+/**
+ * convert (ipv4_t)@addr to ipv4u32_t and return it
+ */
+ipv4u32_t             ipv4tou32           (const ipv4_t         addr);
+
+
+/**
+ * convert @n to ipv4_t and store to @addr
+ */
+void                  u32toipv4           (ipv4_t               addr,
+                                           ipv4u32_t            n);
+
+
+/**
+ * convert net mask @smask in slash form (24) to its 32-bit value (0xffffff00)
+ */
+ipv4u32_t             masktou32           (unsigned char        smask);
+
+
+/**
+ * advance *@addr by @nhosts.
+ * Return 0 if fail (*@addr is left untouched), non-zero if successful
+ */
+int                   ipv4add32           (ipv4u32_t          * addr,
+                                           unsigned long        nhosts);
+
+
+/**
+ * RETURN the broadcast/first/last address of network (@network_addr & @mask)
+ */
+ipv4u32_t             calbroadcast32      (ipv4u32_t            network_addr,
+                                           unsigned char        mask);
+
+ipv4u32_t             calfirst32          (ipv4u32_t            network_addr,
+                                           unsigned char        mask);
+
+ipv4u32_t             callast32           (ipv4u32_t            network_addr,
+                                           unsigned char        mask);
+
+
+/**
+ * RETURN the network address of @addr with net mask @smask
+ */
+ipv4u32_t             ipv4tonet32         (ipv4u32_t            addr,
+                                           unsigned char        smask);
+
 #endif
 
 #ifdef __cplusplus